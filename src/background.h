@@ -0,0 +1,734 @@
+#ifndef H_BACKGROUND
+#define H_BACKGROUND
+
+#include "common.h"
+
+#ifdef USE_ADT
+#include "lzss.h"
+#endif
+
+#ifdef USE_BSS
+#include "mdec.h"
+#endif
+
+#define BG_WIDTH            320
+#define BG_HEIGHT           240
+#define MAX_BG_CACHE        64
+#define MAX_BG_PREFETCH     8
+#define BG_CACHE_BUDGET     (32 << 20) // default GPU memory budget for cached backgrounds in bytes
+
+// decoded camera background, CPU side only
+struct BackgroundImage
+{
+    uint8* data32;  // BG_WIDTH x BG_HEIGHT RGBA
+    uint8* masks32; // NULL if the camera has no masks
+    int32 masksWidth;
+    int32 masksHeight;
+
+    void free()
+    {
+        delete[] data32;
+        delete[] masks32;
+        data32 = NULL;
+        masks32 = NULL;
+    }
+};
+
+#ifdef USE_ADT
+#define MAX_BG_BUFFER_SIZE ((320 * 256 * 2) * 2)
+
+bool loadBackgroundADT(int32 stageIndex, int32 roomIndex, int32 cameraIndex, BackgroundImage* image)
+{
+    MmapStream stream("COMMON/BIN/ROOMCUT.BIN");
+    if (!stream.isValid())
+        return false;
+
+    int32 index = (stageIndex - 1) * 512 + roomIndex * 16 + cameraIndex;
+
+    int32 off = stream.u32();
+    int32 count = off / 4;
+    ASSERT(index < count);
+
+    stream.setPos(index * 4);
+    int32 offset = stream.s32();
+    int32 size;
+    if (index == count - 1)
+    {
+        size = stream.getSize() - offset;
+    }
+    else
+    {
+        size = stream.s32() - offset;
+    }
+    ASSERT(size > 0);
+
+    const uint8* data = stream.span(offset, size);
+
+    uint8* buffer = new uint8[MAX_BG_BUFFER_SIZE];
+    buffer[320 * 256 * 2] = 0xFF; // special mark to override by masks data
+
+    unpackImage(data + 4, size - 4, buffer); // skip magic
+
+    uint8* data32 = new uint8[BG_WIDTH * BG_HEIGHT * 4];
+    uint16* src = (uint16*)buffer;
+    uint8* dst = data32;
+
+    for (int32 y = 0; y < 240; y++)
+    {
+        for (int32 x = 0; x < 256; x++)
+        {
+            uint16 value = *src++;
+
+            *dst++ = (value & 31) << 3;
+            *dst++ = ((value >> 5) & 31) << 3;
+            *dst++ = ((value >> 10) & 31) << 3;
+            *dst++ = 255;
+        }
+
+        uint16* part = (uint16*)buffer + 256 * 256 + y * 128;
+
+        if (y >= 128)
+        {
+            part -= 128 * 128 - 64;
+        }
+
+        for (int32 x = 0; x < 64; x++)
+        {
+            uint16 value = *part++;
+
+            *dst++ = (value & 31) << 3;
+            *dst++ = ((value >> 5) & 31) << 3;
+            *dst++ = ((value >> 10) & 31) << 3;
+            *dst++ = 255;
+        }
+    }
+
+    image->data32 = data32;
+    image->masks32 = NULL;
+
+    if (buffer[320 * 256 * 2] != 0xFF) // has masks
+    {
+        MemoryStream masksStream(buffer, MAX_BG_BUFFER_SIZE);
+        masksStream.setPos(320 * 256 * 2);
+
+        Texture tex;
+        image->masks32 = tex.loadData(&masksStream, image->masksWidth, image->masksHeight);
+    }
+
+#if 0
+#ifdef _DEBUG
+    dumpBitmap("rooms.bmp", 320, 240, data32);
+#endif
+#endif
+
+    delete[] buffer;
+
+    return true;
+}
+#endif
+
+#ifdef USE_BSS
+// based on Patrice Mandin code https://github.com/pmandin/reevengi-tools/wiki/.BSS
+uint8* bss_tim_re2(const uint8* src, int32& size)
+{
+    if (*(const uint16*)(src + 4) != 0xFFFF)
+    {
+        size = 0;
+        return NULL;
+    }
+    size = (*((const uint32*)src)); // TODO BE support
+    src += 6;
+
+    uint8* dst = new uint8[size];
+    const uint8* ret = src;
+
+    int count;
+    while (1)
+    {
+        while (!(*src & 0x10))
+        {
+            int32 prev = *src & 0x0F;
+            int32 offset = ((*src++ & 0xE0) - 256) << 3;
+            offset |= *src++;
+
+            if (prev == 0x0F)
+            {
+                prev += *src++;
+            }
+            prev += 3;
+
+            while (prev--)
+            {
+                dst[0] = dst[offset];
+                dst++;
+            }
+        }
+
+        if (*src == 0xff)
+            break;
+
+        int32 next = ((*src++ | 0xFFE0) ^ 0xFFFF) + 1;
+        if (next == 0x10)
+        {
+            next += *src++;
+        }
+
+        memcpy(dst, src, next);
+        dst += next;
+        src += next;
+    }
+
+    return dst - size;
+}
+
+bool loadBackgroundBSS(int32 stageIndex, int32 roomIndex, int32 cameraIndex, BackgroundImage* image)
+{
+    char path[32];
+    strcpy(path, "COMMON/BSS/ROOM");
+    path[15] = '0' + stageIndex;
+    addSuffix(path + 16, roomIndex);
+    strcat(path, ".BSS");
+
+    MmapStream stream(path);
+    if (!stream.isValid())
+        return false;
+
+    int32 sectionSize = 64 << 10; // TODO: 32 for RE1
+    stream.skip(cameraIndex * sectionSize);
+
+    int32 length = stream.u16();
+    int32 id = stream.u16();
+    ASSERT(id == 0x3800);
+    int32 qscale = stream.u16();
+    int32 version = stream.u16();
+
+    int32 bufSize = stream.getSize() - stream.getPos();
+    if (bufSize > sectionSize)
+        bufSize = sectionSize;
+
+    const uint8* buffer = stream.span(stream.getPos(), bufSize);
+
+    uint8* data32 = new uint8[BG_WIDTH * BG_HEIGHT * 4];
+
+    int32 maskOffset = mdec_decodeParallel(buffer, bufSize, version, BG_WIDTH, BG_HEIGHT, qscale, data32, &workers);
+
+    // TODO proper calc of maskOffset
+    maskOffset += 3;
+    while (1)
+    {
+        uint32 mask = buffer[maskOffset + 1] | (buffer[maskOffset + 2] << 8);
+        if ((buffer[maskOffset] == 0) && (mask == 0xFFFF || mask == 0x0000))
+        {
+            maskOffset -= 3;
+            break;
+        }
+        maskOffset++;
+    }
+
+    image->data32 = data32;
+    image->masks32 = NULL;
+
+    int32 timSize;
+    uint8* timData = bss_tim_re2(buffer + maskOffset, timSize);
+    if (timData)
+    {
+        MemoryStream masksStream(timData, timSize);
+
+        Texture tex;
+        image->masks32 = tex.loadData(&masksStream, image->masksWidth, image->masksHeight);
+        delete[] timData;
+    }
+
+    return true;
+}
+#endif
+
+bool loadBackgroundImage(int32 stageIndex, int32 roomIndex, int32 cameraIndex, BackgroundImage* image)
+{
+#ifdef USE_ADT
+    if (loadBackgroundADT(stageIndex, roomIndex, cameraIndex, image))
+        return true;
+#endif
+
+#ifdef USE_BSS
+    if (loadBackgroundBSS(stageIndex, roomIndex, cameraIndex, image))
+        return true;
+#endif
+
+    return false;
+}
+
+// called by the main, loader & prefetch threads
+bool loadBackground(int32 stageIndex, int32 roomIndex, int32 cameraIndex, BackgroundImage* image)
+{
+    int64 startTime = osGetTimeUS();
+
+    bool loaded = loadBackgroundImage(stageIndex, roomIndex, cameraIndex, image);
+
+    gCounters.addAtomic(CNT_DECODE_TIME, int32(osGetTimeUS() - startTime));
+
+    return loaded;
+}
+
+// decodes backgrounds of the neighbour cameras on a separate thread, the closest first
+struct BackgroundPrefetcher
+{
+    enum State
+    {
+        STATE_NONE,
+        STATE_QUEUED,
+        STATE_LOADING,
+        STATE_READY
+    };
+
+    struct Request
+    {
+        int32 key;
+        int32 priority; // distance to the camera switch, lower is loaded first
+        State state;
+        bool loaded;
+        BackgroundImage image;
+    };
+
+    Mutex mutex;
+    Condition changed;
+    Thread thread;
+    Request requests[MAX_BG_PREFETCH];
+    bool quit;
+    int32 stalls; // waits for the image being decoded
+
+    void init()
+    {
+        memset(requests, 0, sizeof(requests));
+        quit = false;
+        stalls = 0;
+        thread.start(worker, this);
+    }
+
+    void free()
+    {
+        mutex.lock();
+        quit = true;
+        changed.broadcast();
+        mutex.unlock();
+
+        thread.join();
+
+        for (int32 i = 0; i < MAX_BG_PREFETCH; i++)
+        {
+            if (requests[i].state == STATE_READY && requests[i].loaded)
+            {
+                requests[i].image.free();
+            }
+            requests[i].state = STATE_NONE;
+        }
+    }
+
+    Request* find(int32 key)
+    {
+        for (int32 i = 0; i < MAX_BG_PREFETCH; i++)
+        {
+            if (requests[i].state != STATE_NONE && requests[i].key == key)
+                return requests + i;
+        }
+        return NULL;
+    }
+
+    // replaces the queue by the new set of keys, requests in progress are kept
+    void request(const int32* keys, const int32* priorities, int32 count)
+    {
+        mutex.lock();
+
+        for (int32 i = 0; i < MAX_BG_PREFETCH; i++)
+        {
+            if (requests[i].state == STATE_QUEUED)
+            {
+                requests[i].state = STATE_NONE;
+            }
+        }
+
+        for (int32 i = 0; i < count; i++)
+        {
+            Request* req = find(keys[i]);
+
+            if (!req)
+            {
+                for (int32 j = 0; j < MAX_BG_PREFETCH && !req; j++)
+                {
+                    if (requests[j].state == STATE_NONE)
+                    {
+                        req = requests + j;
+                    }
+                }
+
+                if (!req)
+                    break;
+
+                req->key = keys[i];
+                req->state = STATE_QUEUED;
+            }
+
+            req->priority = priorities[i];
+        }
+
+        changed.broadcast();
+        mutex.unlock();
+    }
+
+    // moves the decoded image to the caller, waits if the image is decoding right now
+    bool take(int32 key, BackgroundImage* image, bool wait)
+    {
+        bool loaded = false;
+
+        mutex.lock();
+
+        Request* req = find(key);
+
+        if (req && req->state == STATE_QUEUED)
+        {
+            req->state = STATE_NONE;
+            req = NULL;
+        }
+
+        if (req && wait && req->state == STATE_LOADING)
+        {
+            stalls++;
+            gCounters.add(CNT_BG_STALLS);
+            while (req->state == STATE_LOADING)
+            {
+                changed.wait(mutex);
+            }
+        }
+
+        if (req && req->state == STATE_READY)
+        {
+            loaded = req->loaded;
+            *image = req->image;
+            req->state = STATE_NONE;
+        }
+
+        mutex.unlock();
+
+        return loaded;
+    }
+
+    // returns the key of any decoded request or -1
+    int32 getReady()
+    {
+        int32 key = -1;
+
+        mutex.lock();
+        for (int32 i = 0; i < MAX_BG_PREFETCH; i++)
+        {
+            if (requests[i].state == STATE_READY)
+            {
+                key = requests[i].key;
+                break;
+            }
+        }
+        mutex.unlock();
+
+        return key;
+    }
+
+    static void worker(void* param)
+    {
+        BackgroundPrefetcher* prefetcher = (BackgroundPrefetcher*)param;
+
+        prefetcher->mutex.lock();
+        while (1)
+        {
+            Request* req = NULL;
+
+            while (!prefetcher->quit)
+            {
+                for (int32 i = 0; i < MAX_BG_PREFETCH; i++)
+                {
+                    Request* r = prefetcher->requests + i;
+                    if (r->state == STATE_QUEUED && (!req || r->priority < req->priority))
+                    {
+                        req = r;
+                    }
+                }
+
+                if (req)
+                    break;
+
+                prefetcher->changed.wait(prefetcher->mutex);
+            }
+
+            if (!req) // quit
+                break;
+
+            req->state = STATE_LOADING;
+            int32 key = req->key;
+
+            prefetcher->mutex.unlock();
+
+            BackgroundImage image;
+            bool loaded = loadBackground(key >> 16, (key >> 8) & 0xFF, key & 0xFF, &image);
+
+            prefetcher->mutex.lock();
+
+            req->image = image;
+            req->loaded = loaded;
+            req->state = STATE_READY;
+
+            prefetcher->changed.broadcast();
+        }
+        prefetcher->mutex.unlock();
+    }
+};
+
+// LRU cache of uploaded camera backgrounds, revisiting a camera doesn't decode it again
+struct BackgroundCache
+{
+    struct Entry
+    {
+        int32 key; // -1 for unused entries
+        uint32 lastUse;
+        int32 size;
+        Texture background;
+        Texture masks;
+    };
+
+    Entry entries[MAX_BG_CACHE];
+    BackgroundPrefetcher prefetcher;
+    int32 budget;
+    int32 size;
+    int32 pinnedKey; // the background on screen, never evicted
+    uint32 useCounter;
+
+    int32 hits;
+    int32 misses;
+    int32 evictions;
+    int32 prefetched; // misses served by the prefetcher
+
+    void init(int32 budgetBytes)
+    {
+        memset(entries, 0, sizeof(entries));
+        for (int32 i = 0; i < MAX_BG_CACHE; i++)
+        {
+            entries[i].key = -1;
+        }
+
+        budget = budgetBytes;
+        size = 0;
+        pinnedKey = -1;
+        useCounter = 0;
+        hits = misses = evictions = prefetched = 0;
+
+        prefetcher.init();
+    }
+
+    void free()
+    {
+        prefetcher.free();
+
+        for (int32 i = 0; i < MAX_BG_CACHE; i++)
+        {
+            if (entries[i].key != -1)
+            {
+                remove(entries + i);
+            }
+        }
+    }
+
+    static int32 getKey(int32 stageIndex, int32 roomIndex, int32 cameraIndex)
+    {
+        return (stageIndex << 16) | (roomIndex << 8) | cameraIndex;
+    }
+
+    Entry* find(int32 key)
+    {
+        for (int32 i = 0; i < MAX_BG_CACHE; i++)
+        {
+            if (entries[i].key == key)
+                return entries + i;
+        }
+        return NULL;
+    }
+
+    void remove(Entry* entry)
+    {
+        if (entry->background.res)
+        {
+            entry->background.free();
+        }
+
+        if (entry->masks.res)
+        {
+            entry->masks.free();
+        }
+
+        size -= entry->size;
+        entry->key = -1;
+        entry->size = 0;
+    }
+
+    // frees the least recently used entries until the new one fits into the budget
+    Entry* alloc(int32 entrySize)
+    {
+        while (1)
+        {
+            Entry* empty = NULL;
+            Entry* oldest = NULL;
+
+            for (int32 i = 0; i < MAX_BG_CACHE; i++)
+            {
+                Entry* entry = entries + i;
+
+                if (entry->key == -1)
+                {
+                    if (!empty)
+                    {
+                        empty = entry;
+                    }
+                    continue;
+                }
+
+                if (entry->key == pinnedKey)
+                    continue;
+
+                if (!oldest || entry->lastUse < oldest->lastUse)
+                {
+                    oldest = entry;
+                }
+            }
+
+            if (empty && (size + entrySize <= budget || !oldest))
+                return empty;
+
+            if (!oldest)
+                return NULL;
+
+            remove(oldest);
+            evictions++;
+            gCounters.add(CNT_BG_EVICTIONS);
+        }
+    }
+
+    Entry* add(int32 key, const BackgroundImage* image)
+    {
+        int32 entrySize = BG_WIDTH * BG_HEIGHT * 4;
+        if (image->masks32)
+        {
+            entrySize += image->masksWidth * image->masksHeight * 4;
+        }
+
+        Entry* entry = alloc(entrySize);
+        if (!entry)
+            return NULL;
+
+        entry->key = key;
+        entry->lastUse = ++useCounter;
+        entry->size = entrySize;
+        size += entrySize;
+
+        entry->background.x = 0;
+        entry->background.y = 0;
+        entry->background.count = 1;
+        entry->background.init(image->data32, BG_WIDTH, BG_HEIGHT);
+
+        if (image->masks32)
+        {
+            entry->masks.init(image->masks32, image->masksWidth, image->masksHeight);
+        }
+
+        return entry;
+    }
+
+    // returns the camera background ready to render, decodes and uploads it on a miss
+    const Entry* get(int32 stageIndex, int32 roomIndex, int32 cameraIndex)
+    {
+        int32 key = getKey(stageIndex, roomIndex, cameraIndex);
+
+        Entry* entry = find(key);
+        bool hit = entry != NULL;
+
+        if (hit)
+        {
+            hits++;
+            gCounters.add(CNT_BG_HITS);
+            entry->lastUse = ++useCounter;
+        }
+        else
+        {
+            misses++;
+            gCounters.add(CNT_BG_MISSES);
+
+            BackgroundImage image;
+
+            if (prefetcher.take(key, &image, true))
+            {
+                prefetched++;
+                gCounters.add(CNT_BG_PREFETCHED);
+            }
+            else if (!loadBackground(stageIndex, roomIndex, cameraIndex, &image))
+            {
+                return NULL;
+            }
+
+            pinnedKey = -1; // the previous background may be evicted now
+            entry = add(key, &image);
+            image.free();
+
+            ASSERT(entry);
+        }
+
+        pinnedKey = key;
+
+        LOG("bg cache %s [%d %d %d] hits: %d misses: %d prefetched: %d stalls: %d evictions: %d size: %d KB\n",
+            hit ? "hit" : "miss", stageIndex, roomIndex, cameraIndex, hits, misses, prefetched, prefetcher.stalls, evictions, size >> 10);
+
+        return entry;
+    }
+
+    // queues decoding of the backgrounds that are not cached yet
+    void prefetch(const int32* keys, const int32* priorities, int32 count)
+    {
+        int32 newKeys[MAX_BG_PREFETCH];
+        int32 newPriorities[MAX_BG_PREFETCH];
+        int32 newCount = 0;
+
+        for (int32 i = 0; i < count && newCount < MAX_BG_PREFETCH; i++)
+        {
+            if (find(keys[i]))
+                continue;
+
+            newKeys[newCount] = keys[i];
+            newPriorities[newCount] = priorities[i];
+            newCount++;
+        }
+
+        prefetcher.request(newKeys, newPriorities, newCount);
+    }
+
+    // uploads the prefetched backgrounds, must be called from the render thread
+    void update()
+    {
+        int32 key;
+        while ((key = prefetcher.getReady()) != -1)
+        {
+            BackgroundImage image;
+            if (!prefetcher.take(key, &image, false))
+                continue;
+
+            insert(key, &image);
+            image.free();
+        }
+    }
+
+    // adds the background decoded elsewhere, must be called from the render thread
+    void insert(int32 key, const BackgroundImage* image)
+    {
+        if (!find(key))
+        {
+            add(key, image);
+        }
+    }
+};
+
+BackgroundCache bgCache;
+
+#endif
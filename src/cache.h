@@ -0,0 +1,123 @@
+#ifndef H_CACHE
+#define H_CACHE
+
+#include "common.h"
+
+#define MAX_CACHED_MODELS   64
+#define MAX_ASSET_PATH      32
+
+// models shared by all the instances loaded from the same file
+struct ModelCache
+{
+    struct Entry
+    {
+        char path[MAX_ASSET_PATH];
+        int32 refCount;
+        Model* model;
+    };
+
+    Entry entries[MAX_CACHED_MODELS];
+    int32 count;
+
+    int32 hits;
+    int32 misses;
+
+    void init()
+    {
+        count = 0;
+        hits = misses = 0;
+    }
+
+    void free()
+    {
+        for (int32 i = 0; i < count; i++)
+        {
+            ASSERT(entries[i].refCount == 0);
+            entries[i].model->free();
+            delete entries[i].model;
+        }
+        count = 0;
+    }
+
+    // returns the cached model and adds a reference to it
+    Model* acquire(const char* path)
+    {
+        for (int32 i = 0; i < count; i++)
+        {
+            Entry* entry = entries + i;
+            if (!strcmp(entry->path, path))
+            {
+                entry->refCount++;
+                hits++;
+                return entry->model;
+            }
+        }
+
+        misses++;
+        return NULL;
+    }
+
+    // takes the ownership of the loaded model with one reference
+    // the model stays uncached if the table is full or the path doesn't fit, release deletes it
+    Model* add(const char* path, Model* model)
+    {
+        if (count >= MAX_CACHED_MODELS || strlen(path) >= MAX_ASSET_PATH)
+        {
+            LOG("model %s isn't cached\n", path);
+            return model;
+        }
+
+        Entry* entry = entries + count++;
+        strcpy(entry->path, path);
+        entry->refCount = 1;
+        entry->model = model;
+
+        return model;
+    }
+
+    void release(Model* model)
+    {
+        if (!model)
+            return;
+
+        for (int32 i = 0; i < count; i++)
+        {
+            if (entries[i].model == model)
+            {
+                ASSERT(entries[i].refCount > 0);
+                entries[i].refCount--;
+                return;
+            }
+        }
+
+        // uncached by add
+        model->free();
+        delete model;
+    }
+
+    // frees the models with no references
+    void purge()
+    {
+        int32 i = 0;
+        while (i < count)
+        {
+            Entry* entry = entries + i;
+
+            if (entry->refCount > 0)
+            {
+                i++;
+                continue;
+            }
+
+            entry->model->free();
+            delete entry->model;
+            *entry = entries[--count];
+        }
+
+        LOG("model cache: %d models hits: %d misses: %d\n", count, hits, misses);
+    }
+};
+
+ModelCache modelCache;
+
+#endif
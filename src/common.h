@@ -2,6 +2,8 @@
 #define H_COMMON
 
 #include "types.h"
+#include "profiler.h"
+#include "counters.h"
 
 const char* HEX = "0123456789ABCDEF";
 
@@ -14,6 +16,12 @@ void addSuffix(char* str, int32 value)
 
 extern int32 gFrameIndex;
 extern int32 gLastFrameIndex;
+extern int32 gTickFactor;
+
+uint32 osGetSystemTimeMS();
+int64 osGetTimeUS(); // monotonic
+int64 osGetFileTime(const char* path); // -1 if the file doesn't exist
+bool osSaveFile(const char* path, const void* data, int32 size);
 
 #define x_sqrt(x)       sqrt((uint32)x)
 #define x_min(a,b)      ((a) < (b) ? (a) : (b))
@@ -24,6 +32,9 @@ extern int32 gLastFrameIndex;
 #include "stream.h"
 #include "input.h"
 #include "render.h"
+#include "cook.h"
+#include "loader.h"
+#include "cache.h"
 #include "collision.h"
 #include "player.h"
 #include "enemy.h"
@@ -0,0 +1,102 @@
+#ifndef H_COOK
+#define H_COOK
+
+#include "common.h"
+
+// cooked models are the final vertex & index buffers, decoded texture and animations
+// saved by the first load to the cooked folder, the next runs only map them
+
+#define COOK_DIR        "cooked/"
+#define COOK_MAGIC      0x4B4F4F43 // "COOK"
+#define COOK_VERSION    2
+#define MAX_COOKED_PATH 64
+
+struct CookHeader
+{
+    uint32 magic;
+    uint32 version;
+    int64 modelTime;    // source files time, the cooked file is stale if any of them changed
+    int64 textureTime;
+};
+
+// returns false if the path doesn't fit MAX_COOKED_PATH
+bool getCookedPath(char* dst, const char* path)
+{
+    if (strlen(COOK_DIR) + strlen(path) >= MAX_COOKED_PATH)
+        return false;
+
+    strcpy(dst, COOK_DIR);
+    dst += strlen(dst);
+
+    while (*path)
+    {
+        char c = *path++;
+        *dst++ = (c == '/' || c == '\\') ? '_' : c;
+    }
+    *dst = '\0';
+
+    return true;
+}
+
+// loads the model data with the optional external texture, doesn't touch the GPU
+void loadModelCooked(Model* model, const char* path, const char* texturePath)
+{
+    CookHeader header;
+    header.magic = COOK_MAGIC;
+    header.version = COOK_VERSION;
+    header.modelTime = osGetFileTime(path);
+    header.textureTime = texturePath ? osGetFileTime(texturePath) : 0;
+
+    char cookedPath[MAX_COOKED_PATH];
+    bool cookable = getCookedPath(cookedPath, path);
+
+    if (cookable)
+    {
+        MmapStream* cooked = new MmapStream(cookedPath);
+
+        if (cooked->getSize() >= sizeof(header))
+        {
+            const CookHeader* h = (const CookHeader*)cooked->span(0, sizeof(header));
+
+            if (!memcmp(h, &header, sizeof(header)) && model->loadCooked(cooked, sizeof(header)))
+                return;
+
+            LOG("cooked file is stale %s\n", cookedPath);
+        }
+
+        delete cooked;
+    }
+    else
+    {
+        LOG("path is too long to cook %s\n", path);
+    }
+
+    {
+        MmapStream stream(path);
+        ASSERT(stream.isValid());
+        model->loadData(&stream);
+    }
+
+    if (texturePath)
+    {
+        MmapStream stream(texturePath);
+        ASSERT(stream.isValid());
+        model->loadTextureData(&stream);
+    }
+
+    if (!cookable || header.modelTime < 0)
+        return;
+
+    int32 size;
+    uint8* blob = model->cook(sizeof(header), size);
+    memcpy(blob, &header, sizeof(header));
+
+    if (!osSaveFile(cookedPath, blob, size))
+    {
+        LOG("can't save cooked file %s\n", cookedPath);
+    }
+
+    delete[] blob;
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef H_COUNTERS
+#define H_COUNTERS
+
+#include <stdio.h>
+
+#include "types.h"
+
+// per frame counters of the renderer & the simulation, shown by the overlay and saved to a csv file
+
+#define COUNTERS_HISTORY    64 // frames of the peak values, power of two
+
+#ifdef _WIN32
+    #include <intrin.h>
+    #define counterAtomicAdd(x, v)  _InterlockedExchangeAdd((volatile long*)&(x), (v))
+    #define counterAtomicSwap(x, v) _InterlockedExchange((volatile long*)&(x), (v))
+#else
+    #define counterAtomicAdd(x, v)  __sync_fetch_and_add(&(x), (v))
+    #define counterAtomicSwap(x, v) __sync_lock_test_and_set(&(x), (v))
+#endif
+
+enum CounterType
+{
+    CNT_FRAME_TIME,         // us
+    CNT_DRAW_CALLS,
+    CNT_UNIFORMS,           // uniform & joints buffer uploads
+    CNT_TEXTURES,           // texture uploads
+    CNT_TEXTURE_BYTES,
+    CNT_COLLISIONS,         // collision shape tests
+    CNT_CAMERA_SWITCHES,    // camera switch zone tests
+    CNT_SCRIPT_OPS,         // script opcodes executed by the room
+    CNT_DECODE_TIME,        // us, background decoding on any thread
+    CNT_BG_HITS,            // background cache
+    CNT_BG_MISSES,
+    CNT_BG_PREFETCHED,      // misses served by the prefetcher
+    CNT_BG_STALLS,          // waits for the prefetcher
+    CNT_BG_EVICTIONS,
+    CNT_ROOM_PRELOADED,     // room swaps served by the loader thread
+    CNT_ROOM_SYNC,          // room swaps loaded on the main thread
+    CNT_ROOM_SWAP_TIME,     // ms
+    CNT_ROOM_WAIT_TIME,     // ms, the room swap waiting for the loader
+    CNT_ROOM_LOAD_TIME,     // ms, preloads on the loader thread
+    CNT_MAX
+};
+
+static const char* const COUNTER_NAMES[CNT_MAX] = {
+    "frame_us",
+    "draw_calls",
+    "uniforms",
+    "textures",
+    "texture_bytes",
+    "collisions",
+    "camera_switches",
+    "script_ops",
+    "decode_us",
+    "bg_hits",
+    "bg_misses",
+    "bg_prefetched",
+    "bg_stalls",
+    "bg_evictions",
+    "room_preloaded",
+    "room_sync",
+    "room_swap_ms",
+    "room_wait_ms",
+    "room_load_ms"
+};
+
+int64 osGetTimeUS();
+
+struct Counters
+{
+    int32 values[CNT_MAX];  // the current frame
+    int32 last[CNT_MAX];    // the last finished frame
+    int64 totals[CNT_MAX];  // the whole session
+    int32 history[COUNTERS_HISTORY][CNT_MAX];
+    int32 frame;
+    int64 frameStart;
+    FILE* file;
+
+    void init()
+    {
+        memset(this, 0, sizeof(*this));
+        frameStart = osGetTimeUS();
+    }
+
+    void free()
+    {
+        if (file)
+        {
+            fclose(file);
+        }
+        init();
+    }
+
+    // saves the counters of every frame to the file
+    bool open(const char* path)
+    {
+        file = fopen(path, "wb");
+        if (!file)
+        {
+            printf("can't save counters %s\n", path);
+            return false;
+        }
+
+        fprintf(file, "frame");
+        for (int32 i = 0; i < CNT_MAX; i++)
+        {
+            fprintf(file, ",%s", COUNTER_NAMES[i]);
+        }
+        fprintf(file, "\n");
+
+        return true;
+    }
+
+    void add(CounterType type, int32 value = 1)
+    {
+        values[type] += value;
+    }
+
+    static bool isAtomic(CounterType type)
+    {
+        return type == CNT_DECODE_TIME || type == CNT_ROOM_LOAD_TIME;
+    }
+
+    // safe to call from the worker threads, only for the isAtomic counters
+    void addAtomic(CounterType type, int32 value)
+    {
+        ASSERT(isAtomic(type));
+
+        counterAtomicAdd(values[type], value);
+    }
+
+    void endFrame()
+    {
+        int64 time = osGetTimeUS();
+        values[CNT_FRAME_TIME] = int32(time - frameStart);
+        frameStart = time;
+
+        // the counters of the other threads are taken & cleared atomically, the rest only by the main one
+        for (int32 i = 0; i < CNT_MAX; i++)
+        {
+            if (isAtomic(CounterType(i)))
+            {
+                last[i] = counterAtomicSwap(values[i], 0);
+            }
+            else
+            {
+                last[i] = values[i];
+                values[i] = 0;
+            }
+        }
+
+        memcpy(history[frame & (COUNTERS_HISTORY - 1)], last, sizeof(last));
+
+        for (int32 i = 0; i < CNT_MAX; i++)
+        {
+            totals[i] += last[i];
+        }
+
+        if (file)
+        {
+            fprintf(file, "%d", frame);
+            for (int32 i = 0; i < CNT_MAX; i++)
+            {
+                fprintf(file, ",%d", last[i]);
+            }
+            fprintf(file, "\n");
+        }
+
+        frame++;
+    }
+
+    int32 getPeak(CounterType type) const
+    {
+        int32 count = frame < COUNTERS_HISTORY ? frame : COUNTERS_HISTORY;
+        int32 peak = 0;
+        for (int32 i = 0; i < count; i++)
+        {
+            if (history[i][type] > peak)
+            {
+                peak = history[i][type];
+            }
+        }
+        return peak;
+    }
+
+    // "name last peak total" lines of the overlay
+    void getText(char* text) const
+    {
+        text += sprintf(text, "%-16s %7s %7s %10s\n", "counter", "last", "peak", "total");
+        for (int32 i = 0; i < CNT_MAX; i++)
+        {
+            text += sprintf(text, "%-16s %7d %7d %10lld\n", COUNTER_NAMES[i], last[i], getPeak(CounterType(i)), (long long)totals[i]);
+        }
+    }
+};
+
+// defined by the renderer, shared by all translation units
+extern Counters gCounters;
+
+#endif
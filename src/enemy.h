@@ -22,7 +22,7 @@ enum EnemyAnimationID
 struct Enemy
 {
     vec3i pos;
-    Model model;
+    Model* model; // shared by modelCache
 
     int32 animId;
     int32 animFrame;
@@ -39,29 +39,28 @@ struct Enemy
 
     Collision* collision;
 
+    RenderState prevState;
+
     void init(int32 id)
     {
-        // TODO add CDEMD0.EMS & CDEMD1.EMS loader for PSX
         char path[32];
-        strcpy(path, "PL0/EMD0/EM0");
-        addSuffix(path + strlen(path), id);
-        strcat(path, ".EMD");
+        getEnemyPath(path, id);
 
-        {
-            FileStream stream(path);
-            ASSERT(stream.isValid());
-            model.load(&stream);
-        }
+        model = modelCache.acquire(path);
 
+        if (!model)
         {
-            char* str = path + strlen(path);
-            str[-3] = 'T';
-            str[-2] = 'I';
-            str[-1] = 'M';
-
-            FileStream stream(path);
-            ASSERT(stream.isValid());
-            model.texture.load(&stream);
+            model = roomLoader.takeModel(id);
+
+            if (!model)
+            {
+                model = new Model();
+                loadEnemyModel(id, model, getEnemyAnglesMode(id));
+                model->upload();
+                model->freeData();
+            }
+
+            modelCache.add(path, model);
         }
 
         animFrame = 0;
@@ -72,11 +71,14 @@ struct Enemy
         animId = ENEMY_ANIM_WALK;
 
         collision = NULL;
+
+        prevState = getState();
     }
 
     void free()
     {
-        model.free();
+        modelCache.release(model);
+        model = NULL;
         active = false;
     }
 
@@ -90,9 +92,11 @@ struct Enemy
 
     void update()
     {
+        prevState = getState();
+
         angle += turn;
 
-        const ClipInfo clip = model.getClipInfo(animId);
+        const ClipInfo clip = model->getClipInfo(animId);
         frameIndex = clip.animation->getFrameIndex(clip.start + (animFrame % clip.count));
 
         const Skeleton::Frame* frame = clip.skeleton->frames + frameIndex;
@@ -133,9 +137,19 @@ struct Enemy
         collision->type = 0;
     }
 
+    RenderState getState() const
+    {
+        RenderState state;
+        state.pos = pos;
+        state.angle = angle;
+        state.frameIndex = frameIndex;
+        state.animSkeleton = &model->skeleton[0];
+        return state;
+    }
+
     void render()
     {
-        model.render(pos, angle, frameIndex, &model.texture, &model.skeleton[0], &model.skeleton[0]);
+        model->render(prevState, getState(), gTickFactor, &model->texture, &model->skeleton[0]);
     }
 };
 
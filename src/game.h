@@ -2,30 +2,94 @@
 #define H_GAME
 
 #include "common.h"
+#include "replay.h"
 
 int32 gFrames;
+int32 gTickFactor; // time since the last tick in fraction of the tick with FIXED_SHIFT bits
+bool gOverlay; // shows the performance counters of the last frame
 
-void gameInit()
+// places the player at the target of the first camera
+void gameLoadRoom(int32 stageIndex, int32 roomIndex)
 {
-    room.init(MODEL_LEON);
-    room.load(1, 0, 0);
+    room.load(stageIndex, roomIndex, 0);
 
     room.player.pos = room.cameras[room.cameraIndex].target;
     room.player.pos.y = 0;
+    room.player.prevState = room.player.getState();
+}
+
+void gameInit()
+{
+    PROFILE_THREAD("main");
+
+    gCounters.init();
+    workers.init(getCPUCount() - 1);
+    bgCache.init(BG_CACHE_BUDGET);
+    roomLoader.init();
+    modelCache.init();
+
+    room.init(MODEL_LEON);
+    gameLoadRoom(1, 0);
+
+    replay.init();
+}
+
+// records the input of the ticks from the current room
+bool gameRecord(const char* path)
+{
+    if (!replay.record(path))
+        return false;
+
+    replay.header.stageIndex = room.stageIndex;
+    replay.header.roomIndex = room.roomIndex;
+    replay.header.cameraIndex = room.cameraIndex;
+    replay.header.playerPos = room.player.pos;
+    replay.header.playerAngle = room.player.angle;
+
+    return true;
+}
+
+// restores the start state of the recorded ticks
+bool gameReplay(const char* path)
+{
+    if (!replay.play(path))
+        return false;
+
+    const ReplayHeader& header = replay.header;
+
+    room.load(header.stageIndex, header.roomIndex, header.cameraIndex);
+    room.player.pos = header.playerPos;
+    room.player.angle = header.playerAngle;
+    room.player.prevState = room.player.getState();
+
+    return true;
 }
 
 void gameFree()
 {
+    replay.free();
     room.free();
+    roomLoader.free();
+    modelCache.free();
+    bgCache.free();
+
+    workers.free();
+
+    gCounters.free();
 }
 
 void gameTick()
 {
+    PROFILE("gameTick");
+
+    replay.tick();
     room.update();
 }
 
 void gameUpdate()
 {
+    PROFILE("gameUpdate");
+
     gFrames += gFrameIndex - gLastFrameIndex;
     int32 count = gFrames >> 1; // 30 Hz
     gFrames -= count << 1;
@@ -40,13 +104,30 @@ void gameUpdate()
     {
         gameTick();
     }
+
+    // the renderer interpolates the last two ticks by the time passed since the last one
+    int32 subFrame = int32(int64(osGetSystemTimeMS()) * 60 - int64(gFrameIndex) * 1000);
+    subFrame = x_clamp(subFrame, 0, 999);
+
+    gTickFactor = ((gFrames * 1000 + subFrame) << FIXED_SHIFT) / 2000;
 }
 
 void gameRender()
 {
+    PROFILE("gameRender");
+
     renderClear();
 
     room.render();
+
+    if (gOverlay)
+    {
+        char text[2048];
+        gCounters.getText(text);
+        renderOverlay(text);
+    }
+
+    gCounters.endFrame();
 }
 
 #endif
@@ -0,0 +1,507 @@
+#ifndef H_LOADER
+#define H_LOADER
+
+#include "common.h"
+#include "background.h"
+#include "cache.h"
+
+#define MAX_PRELOAD_MODELS  8
+#define MAX_PRELOAD_BG      2
+
+struct RDTHeader
+{
+    uint8 sprites;
+    uint8 cameras;
+    uint8 models;
+    uint8 items;
+    uint8 doors;
+    uint8 unknown5;
+    uint8 reverb;
+    uint8 unknown7;
+};
+
+struct RDTOffsets
+{
+    uint32 samplesInfo;
+    uint32 samplesVH;
+    uint32 samplesVB;
+    uint32 unused0;
+    uint32 unused1;
+    uint32 objEnd;
+    uint32 collision;
+    uint32 cameras;
+    uint32 cameraSwitches;
+    uint32 cameraLights;
+    uint32 modelsInfo;
+    uint32 floors;
+    uint32 blocks;
+    uint32 text1;
+    uint32 text2;
+    uint32 unknown1;
+    uint32 scriptInit;
+    uint32 scriptMain;
+    uint32 spriteAnims;
+    uint32 spriteAnimsEnd;
+    uint32 spriteTex;
+    uint32 spriteTexEnd;
+    uint32 roomObj;
+};
+
+void readRDTHeader(Stream* stream, RDTHeader& header, RDTOffsets& offset)
+{
+    for (int32 i = 0; i < sizeof(header); i++)
+    {
+        ((uint8*)&header)[i] = stream->u8();
+    }
+
+    for (int32 i = 0; i < sizeof(offset) >> 2; i++)
+    {
+        ((uint32*)&offset)[i] = stream->u32();
+    }
+}
+
+MmapStream* openRDT(int32 stageIndex, int32 roomIndex, int32 playerIndex)
+{
+    char path[64];
+    strcpy(path, "PL0/RDT/ROOM____.RDT");
+    path[12] = '0' + stageIndex;
+    addSuffix(path + 13, roomIndex);
+    path[15] = '0' + playerIndex;
+
+    LOG("load [%d %d %d] %s\n", stageIndex, roomIndex, playerIndex, path);
+
+    MmapStream* stream = new MmapStream(path);
+    if (stream->isValid())
+        return stream;
+    delete stream;
+
+    path[6] = 'U';
+
+    stream = new MmapStream(path);
+    if (stream->isValid())
+        return stream;
+    delete stream;
+
+    return NULL;
+}
+
+void getEnemyPath(char* path, int32 id)
+{
+    // TODO add CDEMD0.EMS & CDEMD1.EMS loader for PSX
+    strcpy(path, "PL0/EMD0/EM0");
+    addSuffix(path + strlen(path), id);
+    strcat(path, ".EMD");
+}
+
+// memory/speed choice of the skeleton angles per model, the unpacked tables are faster to evaluate,
+// the packed frames save the memory of the rooms with many enemies, applied by the next load of the model
+enum AnglesMode
+{
+    ANGLES_UNPACKED,
+    ANGLES_PACKED
+};
+
+#define MAX_ENEMY_IDS   256
+
+uint8 gEnemyAnglesMode[MAX_ENEMY_IDS]; // AnglesMode by the enemy id
+AnglesMode gPlayerAnglesMode = ANGLES_UNPACKED; // the player is always on screen
+
+void setEnemyAnglesMode(int32 id, AnglesMode mode)
+{
+    ASSERT(id >= 0 && id < MAX_ENEMY_IDS);
+    gEnemyAnglesMode[id] = mode;
+}
+
+AnglesMode getEnemyAnglesMode(int32 id)
+{
+    ASSERT(id >= 0 && id < MAX_ENEMY_IDS);
+    return AnglesMode(gEnemyAnglesMode[id]);
+}
+
+void applyAnglesMode(Model* model, AnglesMode mode)
+{
+    if (mode == ANGLES_UNPACKED)
+    {
+        model->unpackAngles();
+    }
+}
+
+// parses EMD & TIM of the enemy, doesn't touch the GPU
+void loadEnemyModel(int32 id, Model* model, AnglesMode mode)
+{
+    char path[32];
+    getEnemyPath(path, id);
+
+    char texturePath[32];
+    strcpy(texturePath, path);
+    char* str = texturePath + strlen(texturePath);
+    str[-3] = 'T';
+    str[-2] = 'I';
+    str[-1] = 'M';
+
+    loadModelCooked(model, path, texturePath);
+    applyAnglesMode(model, mode);
+}
+
+// resources referenced by the room init script
+struct ScriptResources
+{
+    int32 cameraIndex; // -1 if the script doesn't set the camera
+    int32 models[MAX_PRELOAD_MODELS];
+    int32 modelsCount;
+
+    void addModel(int32 id)
+    {
+        for (int32 i = 0; i < modelsCount; i++)
+        {
+            if (models[i] == id)
+                return;
+        }
+
+        if (modelsCount < MAX_PRELOAD_MODELS)
+        {
+            models[modelsCount++] = id;
+        }
+    }
+};
+
+void scriptScan(Stream* stream, ScriptResources* resources);
+
+// loads the room behind a door on a separate thread while the player is approaching it,
+// the room swap on the main thread only parses the mapped RDT and uploads the GPU resources
+struct RoomLoader
+{
+    enum State
+    {
+        STATE_IDLE,
+        STATE_QUEUED,
+        STATE_LOADING,
+        STATE_READY
+    };
+
+    Mutex mutex;
+    Condition changed;
+    Thread thread;
+    bool quit;
+
+    State state;
+    bool swapping; // the room swap uses the preloaded resources
+    int32 stageIndex;
+    int32 roomIndex;
+    int32 cameraIndex;
+    int32 playerIndex;
+
+    MmapStream* rdt;
+    ScriptResources resources;
+    char cachedPaths[MAX_CACHED_MODELS][MAX_ASSET_PATH]; // models of the model cache at the request time
+    int32 cachedCount;
+    Model* models[MAX_PRELOAD_MODELS];
+    BackgroundImage backgrounds[MAX_PRELOAD_BG]; // the door camera & the camera set by the init script
+    int32 backgroundKeys[MAX_PRELOAD_BG];
+    int32 backgroundsCount;
+
+    // timings in ms
+    int32 loadTime;     // loader thread time of the last preload
+    int32 waitTime;     // time the room swap was waiting for the loader
+    int32 swapTime;     // room swap time on the main thread
+    int32 preloads;
+
+    void init()
+    {
+        quit = false;
+        state = STATE_IDLE;
+        swapping = false;
+        rdt = NULL;
+        cachedCount = 0;
+        backgroundsCount = 0;
+        loadTime = waitTime = swapTime = 0;
+        preloads = 0;
+        thread.start(worker, this);
+    }
+
+    void free()
+    {
+        mutex.lock();
+        quit = true;
+        changed.broadcast();
+        mutex.unlock();
+
+        thread.join();
+
+        release();
+    }
+
+    bool isTarget(int32 stageIdx, int32 roomIdx, int32 playerIdx) const
+    {
+        return stageIndex == stageIdx && roomIndex == roomIdx && playerIndex == playerIdx;
+    }
+
+    // starts preloading of the room, ignored while the loader is busy with another one
+    void request(int32 stageIdx, int32 roomIdx, int32 cameraIdx, int32 playerIdx)
+    {
+        mutex.lock();
+
+        if (state != STATE_IDLE && isTarget(stageIdx, roomIdx, playerIdx))
+        {
+            mutex.unlock();
+            return;
+        }
+
+        if (state == STATE_READY)
+        {
+            release();
+        }
+
+        if (state == STATE_IDLE)
+        {
+            stageIndex = stageIdx;
+            roomIndex = roomIdx;
+            cameraIndex = cameraIdx;
+            playerIndex = playerIdx;
+
+            // the room swap takes them from the cache, the loader skips them
+            cachedCount = modelCache.count;
+            for (int32 i = 0; i < cachedCount; i++)
+            {
+                strcpy(cachedPaths[i], modelCache.entries[i].path);
+            }
+
+            state = STATE_QUEUED;
+            changed.broadcast();
+        }
+
+        mutex.unlock();
+    }
+
+    // waits for the preload of the room, returns false if the room wasn't requested
+    bool finish(int32 stageIdx, int32 roomIdx, int32 playerIdx)
+    {
+        mutex.lock();
+
+        bool target = (state != STATE_IDLE) && isTarget(stageIdx, roomIdx, playerIdx);
+
+        if (target && state == STATE_QUEUED) // not started yet, the room swap loads it faster
+        {
+            state = STATE_IDLE;
+            target = false;
+        }
+
+        uint32 startTime = osGetSystemTimeMS();
+
+        while (target && state == STATE_LOADING)
+        {
+            changed.wait(mutex);
+        }
+
+        waitTime = osGetSystemTimeMS() - startTime;
+
+        if (!target && state == STATE_READY)
+        {
+            release();
+        }
+
+        swapping = target;
+
+        mutex.unlock();
+
+        return target;
+    }
+
+    void endSwap()
+    {
+        if (swapping)
+        {
+            swapping = false;
+            release();
+        }
+    }
+
+    // the following functions are called by the main thread between finish() and endSwap()
+
+    MmapStream* takeRDT()
+    {
+        if (!swapping)
+            return NULL;
+
+        MmapStream* stream = rdt;
+        rdt = NULL;
+        return stream;
+    }
+
+    // returns the uploaded model, the caller takes the ownership
+    Model* takeModel(int32 id)
+    {
+        if (!swapping)
+            return NULL;
+
+        for (int32 i = 0; i < resources.modelsCount; i++)
+        {
+            Model* model = models[i];
+
+            if (resources.models[i] == id && model)
+            {
+                model->upload();
+                model->freeData();
+                models[i] = NULL;
+                return model;
+            }
+        }
+
+        return NULL;
+    }
+
+    void uploadBackgrounds()
+    {
+        if (!swapping)
+            return;
+
+        for (int32 i = 0; i < backgroundsCount; i++)
+        {
+            bgCache.insert(backgroundKeys[i], backgrounds + i);
+        }
+    }
+
+    void release()
+    {
+        if (state != STATE_READY)
+            return;
+
+        delete rdt;
+        rdt = NULL;
+
+        for (int32 i = 0; i < resources.modelsCount; i++)
+        {
+            if (models[i])
+            {
+                models[i]->freeData();
+                models[i]->free();
+                delete models[i];
+                models[i] = NULL;
+            }
+        }
+
+        for (int32 i = 0; i < backgroundsCount; i++)
+        {
+            backgrounds[i].free();
+        }
+        backgroundsCount = 0;
+
+        state = STATE_IDLE;
+    }
+
+    void load()
+    {
+        PROFILE("RoomLoader::load");
+
+        uint32 startTime = osGetSystemTimeMS();
+
+        rdt = openRDT(stageIndex, roomIndex, playerIndex);
+
+        resources.cameraIndex = -1;
+        resources.modelsCount = 0;
+
+        if (rdt)
+        {
+            RDTHeader header;
+            RDTOffsets offset;
+            readRDTHeader(rdt, header, offset);
+
+            // fault in the mapped pages, the room swap parses the whole file
+            int32 size = rdt->getSize();
+            const uint8* ptr = rdt->span(0, size);
+            volatile uint8 sum = 0;
+            for (int32 i = 0; i < size; i += 4096)
+            {
+                sum += ptr[i];
+            }
+
+            if (offset.scriptInit != 0xFFFFFFFF)
+            {
+                rdt->setPos(offset.scriptInit);
+                scriptScan(rdt, &resources);
+            }
+
+            rdt->setPos(0);
+        }
+
+        for (int32 i = 0; i < resources.modelsCount; i++)
+        {
+            models[i] = NULL;
+
+            if (isCached(resources.models[i]))
+                continue;
+
+            models[i] = new Model();
+            loadEnemyModel(resources.models[i], models[i], getEnemyAnglesMode(resources.models[i]));
+        }
+
+        preloadBackground(cameraIndex);
+
+        if (resources.cameraIndex != -1 && resources.cameraIndex != cameraIndex)
+        {
+            preloadBackground(resources.cameraIndex);
+        }
+
+        loadTime = osGetSystemTimeMS() - startTime;
+        preloads++;
+
+        gCounters.addAtomic(CNT_ROOM_LOAD_TIME, loadTime);
+
+        LOG("preload [%d %d %d] models: %d time: %d ms\n", stageIndex, roomIndex, cameraIndex, resources.modelsCount, loadTime);
+    }
+
+    bool isCached(int32 id) const
+    {
+        char path[MAX_ASSET_PATH];
+        getEnemyPath(path, id);
+
+        for (int32 i = 0; i < cachedCount; i++)
+        {
+            if (!strcmp(cachedPaths[i], path))
+                return true;
+        }
+
+        return false;
+    }
+
+    void preloadBackground(int32 cameraIdx)
+    {
+        if (loadBackground(stageIndex, roomIndex, cameraIdx, backgrounds + backgroundsCount))
+        {
+            backgroundKeys[backgroundsCount++] = BackgroundCache::getKey(stageIndex, roomIndex, cameraIdx);
+        }
+    }
+
+    static void worker(void* param)
+    {
+        RoomLoader* loader = (RoomLoader*)param;
+
+        PROFILE_THREAD("loader");
+
+        loader->mutex.lock();
+        while (1)
+        {
+            while (loader->state != STATE_QUEUED && !loader->quit)
+            {
+                loader->changed.wait(loader->mutex);
+            }
+
+            if (loader->quit)
+                break;
+
+            loader->state = STATE_LOADING;
+            loader->mutex.unlock();
+
+            loader->load();
+
+            loader->mutex.lock();
+            loader->state = STATE_READY;
+            loader->changed.broadcast();
+        }
+        loader->mutex.unlock();
+    }
+};
+
+RoomLoader roomLoader;
+
+#endif
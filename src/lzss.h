@@ -4,450 +4,387 @@
 // The code by Patrice Mandin
 // https://github.com/pmandin/reevengi-tools/wiki/.ADT-(Resident-Evil-2-PC)
 
-/* Uncompressed data */
-
-/* Note: the game allocates 32KB, then allocate more 32KB */
-/* if the dstOffset reach the 32KB limit */
+// Reentrant version: all the decoder state lives in ADTDecoder, symbols are
+// resolved through LZSS_LUT_BITS lookup tables built from the huffman trees,
+// the bit buffer is refilled by 64-bit words
 
 #include "types.h"
 
-uint8* dstPointer;
-int32 dstOffset; /* Position where to write data in the dstPointer buffer */
+#define LZSS_MAX_SYMBOLS    512
+#define LZSS_LUT_BITS       10
+#define LZSS_WINDOW_MASK    0x3FFF
 
-/* Source data */
+struct LZSSTree
+{
+    struct Entry
+    {
+        int16 value; // symbol or the tree node to continue from if bits == 0
+        uint16 bits; // code length
+    };
 
-uint8* srcPointer; /* pointer to source file */
-int32 srcOffset; /* position in source file */
-int32 srcLength; /* length of source file */
-int32 srcNumBit; /* current bit in source file */
-uint8 srcByte; /* Current byte read from file */
+    int32 length; // number of symbols, also the index of the root node
+    int32 lengths[LZSS_MAX_SYMBOLS];
+    uint16 starts[LZSS_MAX_SYMBOLS];
+    int16 nodes[LZSS_MAX_SYMBOLS * 2][2]; // [0] - next node for bit 0, [1] - for bit 1
+    Entry lut[1 << LZSS_LUT_BITS];
 
-/* Unpack structure */
+    void init(int32 count)
+    {
+        length = count;
 
-typedef struct
-{
-    int32 start;
-    int32 length;
-} unpackArray8_t;
+        memset(lengths, 0, sizeof(lengths));
+        memset(starts, 0, sizeof(starts));
+        memset(nodes, 0xFF, sizeof(nodes));
+    }
 
-typedef struct
-{
-    uint32 start;
-    int32 length;
-    uint32* ptr4;
-    unpackArray8_t* ptr8;
-    uint32* ptr16;
-} unpackArray_t;
+    void initCodes()
+    {
+        uint16 freq[17];
+        uint16 tmp[18];
 
-unpackArray_t array1, array2, array3;
+        memset(freq, 0, sizeof(freq));
 
-uint8 tmp32k[32768]; /* Temporary 32KB buffer */
-uint32 tmp32kOffset; /* Position in temp buffer */
+        for (int32 i = 0; i < length; i++)
+        {
+            if (lengths[i] <= 16)
+            {
+                freq[lengths[i]]++;
+            }
+        }
 
-uint8 tmp16k[16384]; /* Temporary 16KB buffer */
-int32 tmp16kOffset;
+        memset(tmp, 0, sizeof(tmp));
 
-uint16 freqArray[17];
+        for (int32 i = 0; i < 16; i++)
+        {
+            tmp[i + 2] = (tmp[i + 1] + freq[i + 1]) << 1;
+        }
 
-void initTmpArray(unpackArray_t* array, int32 start, int32 length)
-{
-    array->start = start;
+        for (int32 i = 0; i < 18; i++)
+        {
+            for (int32 j = 0; j < length; j++)
+            {
+                if (lengths[j] == i)
+                {
+                    starts[j] = tmp[i]++;
+                }
+            }
+        }
+    }
 
-    array->length = length;
+    void initNodes()
+    {
+        int32 nextNode = length + 1;
 
-    array->ptr16 = (uint32*)&tmp32k[tmp32kOffset];
-    tmp32kOffset += length << 5;
+        nodes[length][0] = nodes[length][1] = -1;
+        nodes[nextNode][0] = nodes[nextNode][1] = -1;
 
-    array->ptr8 = (unpackArray8_t*)&tmp32k[tmp32kOffset];
-    tmp32kOffset += length << 3;
+        for (int32 i = 0; i < length; i++)
+        {
+            int32 node = length;
+            int32 code = starts[i];
+            int32 codeLength = lengths[i];
 
-    array->ptr4 = (uint32*)&tmp32k[tmp32kOffset];
-    tmp32kOffset += length << 2;
-}
+            for (int32 j = 0; j < codeLength; j++)
+            {
+                int32 bit = (code >> (codeLength - j - 1)) & 1;
 
-void initTmpArrayData(unpackArray_t* array)
-{
-    int32 i;
+                if (j + 1 == codeLength)
+                {
+                    nodes[node][bit] = i;
+                    break;
+                }
 
-    for (i = 0; i < array->length; i++)
-    {
-        array->ptr4[i] = array->ptr8[i].start = array->ptr8[i].length = array->ptr16[(i << 2)] = 0;
-        array->ptr16[(i << 2) + 1] = array->ptr16[(i << 2) + 2] = array->ptr16[(i << 2) + 3] = 0xffffffff;
-    }
+                if (nodes[node][bit] == -1)
+                {
+                    ASSERT(nextNode < LZSS_MAX_SYMBOLS * 2);
+                    if (nextNode >= LZSS_MAX_SYMBOLS * 2) // broken stream
+                        break;
+                    nodes[node][bit] = nextNode;
+                    nodes[nextNode][0] = nodes[nextNode][1] = -1;
+                    node = nextNode++;
+                }
+                else
+                {
+                    node = nodes[node][bit];
+                }
+            }
+        }
 
-    while (i < array->length << 1)
-    {
-        array->ptr16[(i << 2)] = 0;
-        array->ptr16[(i << 2) + 1] = array->ptr16[(i << 2) + 2] = array->ptr16[(i << 2) + 3] = 0xffffffff;
-        i++;
+        initLUT(length, 0, 0);
     }
-}
-
-int32 readSrcBits(int32 numBits)
-{
-    int32 orMask = 0, andMask;
-    int32 finalValue;
 
-    finalValue = srcByte;
-
-    while (numBits > srcNumBit)
+    void initLUT(int32 node, int32 depth, int32 code)
     {
-        numBits -= srcNumBit;
-        andMask = (1 << srcNumBit) - 1;
-        andMask &= finalValue;
-        andMask <<= numBits;
-        if (srcOffset < srcLength)
+        if (node < length) // leaf
         {
-            finalValue = srcByte = srcPointer[srcOffset++];
+            int32 count = 1 << (LZSS_LUT_BITS - depth);
+            Entry* e = lut + (code << (LZSS_LUT_BITS - depth));
+            for (int32 i = 0; i < count; i++, e++)
+            {
+                e->value = node;
+                e->bits = depth;
+            }
+            return;
         }
-        else
+
+        if (depth == LZSS_LUT_BITS) // long code, continue by the tree
         {
-            finalValue = srcByte = 0;
+            lut[code].value = node;
+            lut[code].bits = 0;
+            return;
         }
-        /*finalValue = srcByte = srcPointer[srcOffset++];*/
-        srcNumBit = 8;
-        orMask |= andMask;
-    }
 
-    srcNumBit -= numBits;
-    finalValue >>= srcNumBit;
-    finalValue = (finalValue & ((1 << numBits) - 1)) | orMask;
-    return finalValue;
-}
+        initLUT(nodes[node][0], depth + 1, (code << 1) | 0);
+        initLUT(nodes[node][1], depth + 1, (code << 1) | 1);
+    }
+};
 
-int32 readSrcOneBit(void)
+struct ADTDecoder
 {
-    srcNumBit--;
-    if (srcNumBit < 0)
-    {
-        srcNumBit = 7;
-        if (srcOffset < srcLength)
-        {
-            srcByte = srcPointer[srcOffset++];
-        }
-        else
-        {
-            srcByte = 0;
-        }
-    }
+    const uint8* src;
+    const uint8* srcEnd;
+    uint64 bitBuf; // MSB aligned
+    int32 bitCount;
 
-    return (srcByte >> srcNumBit) & 1;
-}
+    LZSSTree tree1; // code lengths of tree2
+    LZSSTree tree2; // literals & match lengths
+    LZSSTree tree3; // match offsets
 
-int32 readSrcBitfieldArray(unpackArray_t* array, int32 curIndex)
-{
-    do
+    inline void refill()
     {
-        if (readSrcOneBit())
+        if (src + 8 <= srcEnd)
         {
-            curIndex = array->ptr16[(curIndex << 2) + 3];
+            uint64 word = (uint64(src[0]) << 56) | (uint64(src[1]) << 48) | (uint64(src[2]) << 40) | (uint64(src[3]) << 32) |
+                          (uint64(src[4]) << 24) | (uint64(src[5]) << 16) | (uint64(src[6]) << 8) | uint64(src[7]);
+            bitBuf |= word >> bitCount;
+            src += (63 - bitCount) >> 3;
+            bitCount |= 56;
         }
         else
         {
-            curIndex = array->ptr16[(curIndex << 2) + 2];
+            while (bitCount <= 56)
+            {
+                uint64 value = (src < srcEnd) ? *src++ : 0;
+                bitBuf |= value << (56 - bitCount);
+                bitCount += 8;
+            }
         }
-    } while (curIndex >= array->length);
-
-    return curIndex;
-}
-
-int32 readSrcBitfield(void)
-{
-    int32 numZeroBits = 0;
-    int32 bitfieldValue = 1;
-
-    while (readSrcOneBit() == 0)
-    {
-        numZeroBits++;
     }
 
-    while (numZeroBits > 0)
+    inline uint32 peekBits(int32 count)
     {
-        bitfieldValue = readSrcOneBit() + (bitfieldValue << 1);
-        numZeroBits--;
+        return uint32(bitBuf >> (64 - count));
     }
 
-    return bitfieldValue;
-}
-
-void initUnpackBlockArray(unpackArray_t* array)
-{
-    uint16 tmp[18];
-    int32 i, j;
-
-    memset(tmp, 0, sizeof(tmp));
-
-    for (i = 0; i < 16; i++)
+    inline void skipBits(int32 count)
     {
-        tmp[i + 2] = (tmp[i + 1] + freqArray[i + 1]) << 1;
+        bitBuf <<= count;
+        bitCount -= count;
     }
 
-    for (i = 0; i < 18; i++)
+    inline int32 readBit()
     {
-        int32 startTmp = tmp[i];
-        for (j = 0; j < array->length; j++)
+        if (bitCount < 1)
         {
-            if (array->ptr8[j].length == i)
-            {
-                array->ptr8[j].start = tmp[i]++ & 0xffff;
-            }
+            refill();
         }
+        int32 value = int32(bitBuf >> 63);
+        skipBits(1);
+        return value;
     }
-}
 
-int32 initUnpackBlockArray2(unpackArray_t* array)
-{
-    int32 i, j;
-    int32 curLength = array->length;
-    int32 curArrayIndex = curLength + 1;
-    array->ptr16[(curLength << 2) + 2] = 0xffffffff;
-    array->ptr16[(curLength << 2) + 3] = 0xffffffff;
-    array->ptr16[(curArrayIndex << 2) + 2] = 0xffffffff;
-    array->ptr16[(curArrayIndex << 2) + 3] = 0xffffffff;
-
-    for (i = 0; i < array->length; i++)
+    inline int32 readBits(int32 count)
     {
-        curLength = array->length;
-
-        int32 curPtr8Start = array->ptr8[i].start;
-        int32 curPtr8Length = array->ptr8[i].length;
+        if (!count)
+            return 0;
 
-        for (j = 0; j < curPtr8Length; j++)
+        if (bitCount < count)
         {
-            int32 curMask = 1 << (curPtr8Length - j - 1);
-            int32 arrayOffset;
-
-            if ((curMask & curPtr8Start) != 0)
-            {
-                arrayOffset = 3;
-            }
-            else
-            {
-                arrayOffset = 2;
-            }
-
-            if (j + 1 == curPtr8Length)
-            {
-                array->ptr16[(curLength << 2) + arrayOffset] = i;
-                break;
-            }
-
-            if (array->ptr16[(curLength << 2) + arrayOffset] == -1)
-            {
-                array->ptr16[(curLength << 2) + arrayOffset] = curArrayIndex;
-                array->ptr16[(curArrayIndex << 2) + 2] = array->ptr16[(curArrayIndex << 2) + 3] = -1;
-                curLength = curArrayIndex++;
-            }
-            else
-            {
-                curLength = array->ptr16[(curLength << 2) + arrayOffset];
-            }
+            refill();
         }
+        int32 value = peekBits(count);
+        skipBits(count);
+        return value;
     }
 
-    return array->length;
-}
+    int32 readBitfield()
+    {
+        int32 numZeroBits = 0;
 
-void initUnpackBlock(void)
-{
-    int32 i, j, prevValue, curBit, curBitfield;
-    int32 numValues;
-    uint16 tmp[512];
-    uint32 tmpBufLen;
+        while (readBit() == 0)
+        {
+            numZeroBits++;
+            if (numZeroBits == 30) // broken stream
+                break;
+        }
 
-    /* Initialize array 1 to unpack block */
+        return (1 << numZeroBits) | readBits(numZeroBits);
+    }
 
-    prevValue = 0;
-    for (i = 0; i < array1.length; i++)
+    inline int32 readSymbol(const LZSSTree& tree)
     {
-        if (readSrcOneBit())
-        {
-            array1.ptr8[i].length = readSrcBitfield() ^ prevValue;
-        }
-        else
+        if (bitCount < LZSS_LUT_BITS)
         {
-            array1.ptr8[i].length = prevValue;
+            refill();
         }
-        prevValue = array1.ptr8[i].length;
-    }
 
-    /* Count frequency of values in array 1 */
-    memset(freqArray, 0, sizeof(freqArray));
+        const LZSSTree::Entry& e = tree.lut[peekBits(LZSS_LUT_BITS)];
 
-    for (i = 0; i < array1.length; i++)
-    {
-        numValues = array1.ptr8[i].length;
-        if (numValues <= 16)
+        if (e.bits)
         {
-            freqArray[numValues]++;
+            skipBits(e.bits);
+            return e.value;
         }
-    }
 
-    initUnpackBlockArray(&array1);
-    tmpBufLen = initUnpackBlockArray2(&array1);
+        skipBits(LZSS_LUT_BITS);
 
-    /* Initialize array 2 to unpack block */
+        int32 node = e.value;
+        do
+        {
+            node = tree.nodes[node][readBit()];
+        } while (node >= tree.length);
 
-    if (array2.length > 0)
-    {
-        memset(tmp, 0, array2.length);
+        return node;
     }
 
-    curBit = readSrcOneBit();
-    j = 0;
-    while (j < array2.length)
+    void readLengths(LZSSTree& tree)
     {
-        if (curBit)
+        int32 prevValue = 0;
+        for (int32 i = 0; i < tree.length; i++)
         {
-            curBitfield = readSrcBitfield();
-            for (i = 0; i < curBitfield; i++)
+            if (readBit())
             {
-                tmp[j + i] = readSrcBitfieldArray(&array1, tmpBufLen);
+                prevValue ^= readBitfield();
             }
-            j += curBitfield;
-            curBit = 0;
-            continue;
-        }
-
-        curBitfield = readSrcBitfield();
-        if (curBitfield > 0)
-        {
-            memset(&tmp[j], 0, curBitfield * sizeof(uint16));
-            j += curBitfield;
+            tree.lengths[i] = prevValue;
         }
-        curBit = 1;
     }
 
-    j = 0;
-    for (i = 0; i < array2.length; i++)
+    void initBlock()
     {
-        j = j ^ tmp[i];
-        array2.ptr8[i].length = j;
-    }
+        readLengths(tree1);
+        tree1.initCodes();
+        tree1.initNodes();
 
-    /* Count frequency of values in array 2 */
-    memset(freqArray, 0, sizeof(freqArray));
+        // tree2 code lengths are packed by tree1 with zero runs
+        uint16 tmp[LZSS_MAX_SYMBOLS];
 
-    for (i = 0; i < array2.length; i++)
-    {
-        numValues = array2.ptr8[i].length;
-        if (numValues <= 16)
+        int32 curBit = readBit();
+        int32 j = 0;
+        while (j < tree2.length)
         {
-            freqArray[numValues]++;
-        }
-    }
+            int32 count = readBitfield();
 
-    initUnpackBlockArray(&array2);
+            if (count > tree2.length - j) // broken stream
+            {
+                count = tree2.length - j;
+            }
 
-    /* Initialize array 3 to unpack block */
+            if (curBit)
+            {
+                for (int32 i = 0; i < count; i++)
+                {
+                    tmp[j + i] = readSymbol(tree1);
+                }
+            }
+            else
+            {
+                memset(tmp + j, 0, count * sizeof(uint16));
+            }
 
-    prevValue = 0;
-    for (i = 0; i < array3.length; i++)
-    {
-        if (readSrcOneBit())
-        {
-            array3.ptr8[i].length = readSrcBitfield() ^ prevValue;
+            j += count;
+            curBit ^= 1;
         }
-        else
-        {
-            array3.ptr8[i].length = prevValue;
-        }
-        prevValue = array3.ptr8[i].length;
-    }
 
-    /* Count frequency of values in array 3 */
-    memset(freqArray, 0, sizeof(freqArray));
-
-    for (i = 0; i < array3.length; i++)
-    {
-        numValues = array3.ptr8[i].length;
-        if (numValues <= 16)
+        j = 0;
+        for (int32 i = 0; i < tree2.length; i++)
         {
-            freqArray[numValues]++;
+            j ^= tmp[i];
+            tree2.lengths[i] = j;
         }
-    }
-
-    initUnpackBlockArray(&array3);
-}
-
-int32 unpackImage(uint8* source, int32 length, uint8* destination)
-{
-    int32 blockLength, curBlockLength;
-    int32 tmpBufLen, tmpBufLen1;
-    int32 i;
+        tree2.initCodes();
 
-    srcPointer = source;
-    srcOffset = 0;
-    srcLength = length;
-
-    dstPointer = destination;
-    dstOffset = 0;
+        readLengths(tree3);
+        tree3.initCodes();
+    }
 
-    srcNumBit = 0;
-    srcByte = 0;
+    int32 unpack(const uint8* source, int32 length, uint8* destination)
+    {
+        src = source;
+        srcEnd = source + length;
+        bitBuf = 0;
+        bitCount = 0;
 
-    tmp16kOffset = 0;
-    tmp32kOffset = 0;
+        tree1.init(16);
+        tree2.init(512);
+        tree3.init(16);
 
-    initTmpArray(&array1, 8, 16);
-    initTmpArray(&array2, 8, 512);
-    initTmpArray(&array3, 8, 16);
+        uint8* dst = destination;
 
-    initTmpArrayData(&array1);
-    initTmpArrayData(&array2);
-    initTmpArrayData(&array3);
+        int32 blockLength = readBits(8);
+        blockLength |= readBits(8) << 8;
 
-    memset(tmp16k, 0, sizeof(tmp16k));
+        while (blockLength > 0)
+        {
+            initBlock();
 
-    blockLength = readSrcBits(8);
-    blockLength |= readSrcBits(8) << 8;
-    while (blockLength > 0)
-    {
-        initUnpackBlock();
+            tree2.initNodes();
+            tree3.initNodes();
 
-        tmpBufLen = initUnpackBlockArray2(&array2);
-        tmpBufLen1 = initUnpackBlockArray2(&array3);
+            for (int32 i = 0; i < blockLength; i++)
+            {
+                int32 symbol = readSymbol(tree2);
 
-        curBlockLength = 0;
-        while (curBlockLength < blockLength)
-        {
-            int32 curBitfield = readSrcBitfieldArray(&array2, tmpBufLen);
+                if (symbol < 256)
+                {
+                    *dst++ = symbol;
+                    continue;
+                }
 
-            if (curBitfield < 256)
-            {
-                dstPointer[dstOffset++] = tmp16k[tmp16kOffset++] = curBitfield;
-                tmp16kOffset &= 0x3fff;
-            }
-            else
-            {
-                int32 i;
-                int32 numValues = curBitfield - 0xfd;
-                int32 startOffset;
-                curBitfield = readSrcBitfieldArray(&array3, tmpBufLen1);
-                if (curBitfield != 0)
+                int32 count = symbol - 0xFD;
+                int32 offset = readSymbol(tree3);
+                if (offset != 0)
                 {
-                    int32 numBits = curBitfield - 1;
-                    curBitfield = readSrcBits(numBits) & 0xffff;
-                    curBitfield += 1 << numBits;
+                    int32 numBits = offset - 1;
+                    offset = (readBits(numBits) & 0xFFFF) + (1 << numBits);
                 }
+                offset = (offset & LZSS_WINDOW_MASK) + 1;
 
-                startOffset = (tmp16kOffset - curBitfield - 1) & 0x3fff;
-                for (i = 0; i < numValues; i++)
+                // the window is the tail of already unpacked data
+                // initially filled by zeros
+                int32 pos = int32(dst - destination) - offset;
+                if (pos >= 0)
+                {
+                    const uint8* from = destination + pos;
+                    while (count--)
+                    {
+                        *dst++ = *from++;
+                    }
+                }
+                else
                 {
-                    dstPointer[dstOffset++] = tmp16k[tmp16kOffset++] = tmp16k[startOffset++];
-                    startOffset &= 0x3fff;
-                    tmp16kOffset &= 0x3fff;
+                    while (count--)
+                    {
+                        *dst++ = (pos >= 0) ? destination[pos] : 0;
+                        pos++;
+                    }
                 }
             }
 
-            curBlockLength++;
+            blockLength = readBits(8);
+            blockLength |= readBits(8) << 8;
         }
 
-        blockLength = readSrcBits(8);
-        blockLength |= readSrcBits(8) << 8;
+        return int32(dst - destination);
     }
+};
 
-    return dstOffset;
+int32 unpackImage(const uint8* source, int32 length, uint8* destination)
+{
+    ADTDecoder* decoder = new ADTDecoder();
+    int32 size = decoder->unpack(source, length, destination);
+    delete decoder;
+    return size;
 }
 
 #endif
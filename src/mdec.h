@@ -2,6 +2,14 @@
 #define H_MDEC
 
 #include "types.h"
+#include "thread.h"
+
+#ifndef MDEC_NO_SIMD
+    #include "simd.h"
+    #ifndef SIMD_SCALAR
+        #define MDEC_SIMD
+    #endif
+#endif
 
 // https://psx-spx.consoledev.net/macroblockdecodermdec/
 // https://github.com/grumpycoders/pcsx-redux/
@@ -227,75 +235,271 @@ const uint8 AC_LUT_9[] = {
     0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4D, 0x4D, 0x4D, 0x4D, 0x4D, 0x4D, 0x4D, 0x4D,
 };
 
-struct BitStream
+#define MDEC_AC_BITS        11 // primary AC table covers codes with up to 6 leading zeros
+#define MDEC_AC_LONG_ZEROS  7
+#define MDEC_AC_LONG_BITS   10 // secondary AC table, indexed by the bits after 7 leading zeros
+#define MDEC_DC_BITS        12
+
+enum VLCType
+{
+    VLC_ERROR,
+    VLC_CODE,
+    VLC_EOB,
+    VLC_ESCAPE,
+    VLC_LONG
+};
+
+struct VLC_ENTRY
 {
-    uint16* data;
-    uint32 index;
-    uint32 value;
+    int16 ac;
+    uint8 skip;
+    uint8 length; // code length including the sign bit
+    uint8 type;
+};
 
-    BitStream(uint8* data) : data((uint16*)data), index(0), value(0) {}
+struct DC_ENTRY
+{
+    uint8 size;   // number of the value bits
+    uint8 length; // size code length, 0 - longer than MDEC_DC_BITS
+};
 
-    uint32 getBit()
+struct MDECTables
+{
+    VLC_ENTRY ac[1 << MDEC_AC_BITS];
+    VLC_ENTRY acLong[1 << MDEC_AC_LONG_BITS];
+    DC_ENTRY dcLuma[1 << MDEC_DC_BITS];
+    DC_ENTRY dcChroma[1 << MDEC_DC_BITS];
+
+    static const MDECTables& get()
     {
-        if (!index--)
+        static MDECTables tables;
+        return tables;
+    }
+
+    MDECTables()
+    {
+        memset(this, 0, sizeof(*this));
+
+        // end of block "10"
+        setCode(ac, MDEC_AC_BITS, 0x2, 2, VLC_EOB, 0, 0);
+        // "11s" is (0, +-1)
+        setCode(ac, MDEC_AC_BITS, 0x6, 3, VLC_CODE, 0, 1);
+        setCode(ac, MDEC_AC_BITS, 0x7, 3, VLC_CODE, 0, -1);
+        // escape "000001" + 16 bits
+        setCode(ac, MDEC_AC_BITS, 0x1, 6, VLC_ESCAPE, 0, 0);
+        // the rest of codes with 7+ leading zeros goes to the secondary table
+        setCode(ac, MDEC_AC_BITS, 0x0, MDEC_AC_LONG_ZEROS, VLC_LONG, 0, 0);
+
+        // expand the reference luts for all the codes: nz leading zeros, 1 and up to 7 bits of the code
+        for (int32 nz = 1; nz < 12; nz++)
+        {
+            if (nz == 5) // escape
+                continue;
+
+            const uint8* table;
+            int32 shift;
+            if (nz < 6)
+            {
+                table = AC_LUT_1;
+                shift = 1;
+            }
+            else if (nz < 9)
+            {
+                table = AC_LUT_6;
+                shift = 6;
+            }
+            else
+            {
+                table = AC_LUT_9;
+                shift = 9;
+            }
+
+            for (int32 bits = 0; bits < 128; bits++)
+            {
+                uint32 code = ((1 << 7) | bits) >> (nz - shift);
+
+                int32 idx = table[code];
+                if (idx == 255)
+                    continue;
+
+                const AC_ENTRY& e = MDEC_AC[idx];
+
+                int32 value = (code & (1 << (8 + shift - e.length))) ? -e.ac : e.ac;
+                // leading zeros are implicit in the code value
+                code = ((1 << 7) | bits) >> (nz + 8 - e.length);
+
+                if (nz < MDEC_AC_LONG_ZEROS)
+                {
+                    setCode(ac, MDEC_AC_BITS, code, e.length, VLC_CODE, e.skip, value);
+                }
+                else
+                {
+                    setCode(acLong, MDEC_AC_LONG_BITS, code, e.length - MDEC_AC_LONG_ZEROS, VLC_CODE, e.skip, value);
+                }
+            }
+        }
+
+        // luma DC sizes: "00" - 1, "01" - 2, "100" - 0, "101" - 3, n ones and 0 - n + 2
+        setDC(dcLuma, 0x0, 2, 1);
+        setDC(dcLuma, 0x1, 2, 2);
+        setDC(dcLuma, 0x4, 3, 0);
+        setDC(dcLuma, 0x5, 3, 3);
+        for (int32 n = 2; n < MDEC_DC_BITS; n++)
         {
-            value = *data++; // TODO BE support
-            index = 15;
+            setDC(dcLuma, ((1 << n) - 1) << 1, n + 1, n + 2);
         }
 
-        return (value >> index) & 1;
+        // chroma DC sizes: "00" - 0, "01" - 1, n ones and 0 - n + 1
+        setDC(dcChroma, 0x0, 2, 0);
+        setDC(dcChroma, 0x1, 2, 1);
+        for (int32 n = 1; n < MDEC_DC_BITS; n++)
+        {
+            setDC(dcChroma, ((1 << n) - 1) << 1, n + 1, n + 1);
+        }
     }
 
-    uint32 getU(int32 count)
+    static void setCode(VLC_ENTRY* table, int32 bits, uint32 code, int32 length, VLCType type, int32 skip, int32 ac)
     {
-        uint32 bits = 0;
-
-        while (count--)
+        int32 count = 1 << (bits - length);
+        VLC_ENTRY* e = table + (code << (bits - length));
+        for (int32 i = 0; i < count; i++, e++)
         {
-            bits = (bits << 1) | getBit();
+            e->ac = ac;
+            e->skip = skip;
+            e->length = length;
+            e->type = type;
         }
+    }
 
-        return bits;
+    static void setDC(DC_ENTRY* table, uint32 code, int32 length, int32 size)
+    {
+        int32 count = 1 << (MDEC_DC_BITS - length);
+        DC_ENTRY* e = table + (code << (MDEC_DC_BITS - length));
+        for (int32 i = 0; i < count; i++, e++)
+        {
+            e->size = size;
+            e->length = length;
+        }
     }
+};
 
-    int32 getS(int32 count)
+struct BitStream
+{
+    const uint16* data;
+    const uint16* end;
+    uint64 buffer; // MSB aligned
+    int32 count;
+    int32 loaded; // number of fetched words
+    const MDECTables& tables;
+
+    BitStream(const uint8* data, int32 size) : data((const uint16*)data), end((const uint16*)(data + (size & ~1))), buffer(0), count(0), loaded(0), tables(MDECTables::get()) {}
+
+    inline void refill()
     {
-        if (getBit())
+        while (count <= 48)
         {
-            return getU(count - 1) + (1 << (count - 1));
+            uint64 value = (data < end) ? *data++ : 0; // TODO BE support
+            buffer |= value << (48 - count);
+            count += 16;
+            loaded++;
         }
-        else
+    }
+
+    inline uint32 peek(int32 bits)
+    {
+        if (count < bits)
         {
-            return getU(count - 1) - (1 << count) + 1;
+            refill();
         }
+        return uint32(buffer >> (64 - bits));
     }
 
-    void skip(int32 count)
+    inline void consume(int32 bits)
     {
-        getU(count);
+        buffer <<= bits;
+        count -= bits;
     }
 
-    // http://jpsxdec.blogspot.com/2011/06/decoding-mpeg-like-bitstreams.html
-    bool readCode(int32& skipCount, int32& ac)
+    // number of bytes touched by the consumed bits, aligned to the stream words
+    int32 getSize() const
+    {
+        return ((loaded * 16 - count + 15) >> 4) * 2;
+    }
+
+    uint32 getBit()
+    {
+        uint32 bit = peek(1);
+        consume(1);
+        return bit;
+    }
+
+    uint32 getU(int32 bits)
     {
-        if (getBit())
+        if (!bits)
+            return 0;
+
+        uint32 value = peek(bits);
+        consume(bits);
+        return value;
+    }
+
+    int32 getDC(bool luma)
+    {
+        const DC_ENTRY& e = (luma ? tables.dcLuma : tables.dcChroma)[peek(MDEC_DC_BITS)];
+
+        int32 size;
+        if (e.length)
         {
-            if (getBit())
+            consume(e.length);
+            size = e.size;
+        }
+        else
+        {
+            consume(MDEC_DC_BITS);
+
+            int32 nz = MDEC_DC_BITS;
+            while (getBit())
             {
-                skipCount = 0;
-                ac = getBit() ? -1 : 1;
-                return true;
+                nz++;
+                ASSERT(nz < 24);
+                if (nz == 24) // broken stream
+                    break;
             }
-            return false; // end of block
+            size = nz + (luma ? 2 : 1);
         }
 
-        int32 nz = 1;
-        while (!getBit())
+        if (!size)
+            return 0;
+
+        int32 value = getU(size);
+        if (!(value >> (size - 1)))
         {
-            nz++;
+            value -= (1 << size) - 1;
         }
+        return value;
+    }
 
-        if (nz == 5) // escape code == 0b1000001
+    // http://jpsxdec.blogspot.com/2011/06/decoding-mpeg-like-bitstreams.html
+    bool readCode(int32& skipCount, int32& ac)
+    {
+        const VLC_ENTRY* e = tables.ac + peek(MDEC_AC_BITS);
+
+        if (e->type == VLC_LONG)
+        {
+            consume(MDEC_AC_LONG_ZEROS);
+            e = tables.acLong + peek(MDEC_AC_LONG_BITS);
+        }
+
+        consume(e->length);
+
+        if (e->type == VLC_CODE)
+        {
+            skipCount = e->skip;
+            ac = e->ac;
+            return true;
+        }
+
+        if (e->type == VLC_ESCAPE)
         {
             uint32 esc = getU(16);
             skipCount = esc >> 10;
@@ -305,40 +509,9 @@ struct BitStream
             return true;
         }
 
-        const uint8* table;
-        int32 shift;
-        if (nz < 6)
-        {
-            table = AC_LUT_1;
-            shift = 1;
-        }
-        else if (nz < 9)
-        {
-            table = AC_LUT_6;
-            shift = 6;
-        }
-        else
-        {
-            table = AC_LUT_9;
-            shift = 9;
-        }
-
-        BitStream state = *this;
-        uint32 code = (1 << 7) | state.getU(7);
+        ASSERT(e->type == VLC_EOB);
 
-        code >>= nz - shift;
-
-        ASSERT(table);
-
-        int32 idx = table[code];
-
-        ASSERT(idx != 255);
-
-        const AC_ENTRY& e = MDEC_AC[idx];
-        skip(e.length - nz - 1);
-        skipCount = e.skip;
-        ac = (code & (1 << (8 + shift - e.length))) ? -e.ac : e.ac;
-        return true;
+        return false; // end of block
     }
 };
 
@@ -461,178 +634,342 @@ void mdec_IDCT(int* block, int used_col)
     }
 }
 
-static inline void putQuadRGB24(uint8* image, int* Yblk, int Cr, int Cb)
+static inline void putPixelRGBA(uint8* image, int32 Y, int32 R, int32 G, int32 B)
+{
+    image[0] = CLAMP_SCALE8(Y + R);
+    image[1] = CLAMP_SCALE8(Y + G);
+    image[2] = CLAMP_SCALE8(Y + B);
+    image[3] = 255;
+}
+
+static inline void putQuadRGBA(uint8* image, int32 stride, int* Yblk, int Cr, int Cb)
 {
-    int Y, R, G, B;
+    int R, G, B;
 
     R = MULR(Cr);
     G = MULG2(Cb, Cr);
     B = MULB(Cb);
 
-    Y = MULY(Yblk[0]);
-    image[0 * 3 + 0] = CLAMP_SCALE8(Y + R);
-    image[0 * 3 + 1] = CLAMP_SCALE8(Y + G);
-    image[0 * 3 + 2] = CLAMP_SCALE8(Y + B);
-    Y = MULY(Yblk[1]);
-    image[1 * 3 + 0] = CLAMP_SCALE8(Y + R);
-    image[1 * 3 + 1] = CLAMP_SCALE8(Y + G);
-    image[1 * 3 + 2] = CLAMP_SCALE8(Y + B);
-    Y = MULY(Yblk[8]);
-    image[16 * 3 + 0] = CLAMP_SCALE8(Y + R);
-    image[16 * 3 + 1] = CLAMP_SCALE8(Y + G);
-    image[16 * 3 + 2] = CLAMP_SCALE8(Y + B);
-    Y = MULY(Yblk[9]);
-    image[17 * 3 + 0] = CLAMP_SCALE8(Y + R);
-    image[17 * 3 + 1] = CLAMP_SCALE8(Y + G);
-    image[17 * 3 + 2] = CLAMP_SCALE8(Y + B);
+    putPixelRGBA(image, MULY(Yblk[0]), R, G, B);
+    putPixelRGBA(image + 4, MULY(Yblk[1]), R, G, B);
+    putPixelRGBA(image + stride, MULY(Yblk[8]), R, G, B);
+    putPixelRGBA(image + stride + 4, MULY(Yblk[9]), R, G, B);
 }
 
-inline void YUV2RGB24(int32* blk, uint8* image)
+inline void YUV2RGBA(int32* blk, uint8* image, int32 stride)
 {
     int32* Yblk = blk + 64 * 2;
     int32* Crblk = blk;
     int32* Cbblk = blk + 64;
 
-    for (int32 y = 0; y < 16; y += 2, Crblk += 4, Cbblk += 4, Yblk += 8, image += 8 * 3 * 3)
+    for (int32 y = 0; y < 16; y += 2, Crblk += 4, Cbblk += 4, Yblk += 8, image += stride * 2 - 8 * 4)
     {
         if (y == 8)
         {
             Yblk += 64;
         }
 
-        for (int32 x = 0; x < 4; x++, image += 6, Crblk++, Cbblk++, Yblk += 2)
+        for (int32 x = 0; x < 4; x++, image += 8, Crblk++, Cbblk++, Yblk += 2)
+        {
+            putQuadRGBA(image, stride, Yblk, *Crblk, *Cbblk);
+            putQuadRGBA(image + 8 * 4, stride, Yblk + 64, *(Crblk + 4), *(Cbblk + 4));
+        }
+    }
+}
+
+#ifdef MDEC_SIMD
+static inline void mdec_IDCT_pass(v8i* p)
+{
+    v8i z10 = p[0] + p[4];
+    v8i z11 = p[0] - p[4];
+    v8i z13 = p[2] + p[6];
+    v8i z12 = v8i_sra<AAN_CONST_BITS>((p[2] - p[6]) * FIX_1_414213562) - z13;
+
+    v8i tmp0 = z10 + z13;
+    v8i tmp3 = z10 - z13;
+    v8i tmp1 = z11 + z12;
+    v8i tmp2 = z11 - z12;
+
+    z13 = p[3] + p[5];
+    z10 = p[3] - p[5];
+    z11 = p[1] + p[7];
+    z12 = p[1] - p[7];
+
+    v8i tmp7 = z11 + z13;
+
+    v8i z5 = (z12 - z10) * FIX_1_847759065;
+    v8i tmp6 = v8i_sra<AAN_CONST_BITS>(z10 * FIX_2_613125930 + z5) - tmp7;
+    v8i tmp5 = v8i_sra<AAN_CONST_BITS>((z11 - z13) * FIX_1_414213562) - tmp6;
+    v8i tmp4 = v8i_sra<AAN_CONST_BITS>(z12 * FIX_1_082392200 - z5) + tmp5;
+
+    p[0] = tmp0 + tmp7;
+    p[7] = tmp0 - tmp7;
+    p[1] = tmp1 + tmp6;
+    p[6] = tmp1 - tmp6;
+    p[2] = tmp2 + tmp5;
+    p[5] = tmp2 - tmp5;
+    p[4] = tmp3 + tmp4;
+    p[3] = tmp3 - tmp4;
+}
+
+// the full butterfly gives the same result as the empty column / row shortcuts of mdec_IDCT
+void mdec_IDCT_SIMD(int32* block, int32 used_col)
+{
+    if (used_col == -1)
+    {
+        v8i v = v8i_set1(block[0]);
+        for (int32 i = 0; i < 8; i++)
+        {
+            v8i_store(block + i * 8, v);
+        }
+        return;
+    }
+
+    v8i m[8];
+    for (int32 i = 0; i < 8; i++)
+    {
+        m[i] = v8i_load(block + i * 8);
+    }
+
+    mdec_IDCT_pass(m); // columns
+    v8i_transpose(m);
+    mdec_IDCT_pass(m); // rows
+    v8i_transpose(m);
+
+    for (int32 i = 0; i < 8; i++)
+    {
+        v8i_store(block + i * 8, m[i]);
+    }
+}
+
+void YUV2RGBA_SIMD(int32* blk, uint8* image, int32 stride)
+{
+    const v8i round = v8i_set1(1 << 19);
+
+    for (int32 y = 0; y < 16; y++, image += stride)
+    {
+        const int32* Crblk = blk + (y >> 1) * 8;
+        const int32* Cbblk = Crblk + 64;
+        const int32* Yblk = blk + 64 * (2 + (y >> 3) * 2) + (y & 7) * 8;
+
+        for (int32 x = 0; x < 2; x++, Crblk += 4, Cbblk += 4, Yblk += 64)
+        {
+            v8i Cr = v8i_dupLo(Crblk);
+            v8i Cb = v8i_dupLo(Cbblk);
+            v8i Y = v8i_sll<10>(v8i_load(Yblk)) + round;
+
+            v8i R = Y + Cr * 1434;
+            v8i G = Y + Cb * -351 - Cr * 728;
+            v8i B = Y + Cb * 1807;
+
+            v8i_storeRGBA(image + x * 8 * 4, v8i_sra<20>(R), v8i_sra<20>(G), v8i_sra<20>(B));
+        }
+    }
+}
+#endif
+
+// parse the coefficients of a macroblock, IDCT and colour conversion are done by mdec_buildMacroblock
+void mdec_parseMacroblock(BitStream& bs, int32* prev, int32 version, int32 qscale, int32* blocks, int32* used)
+{
+    memset(blocks, 0, 6 * 64 * sizeof(int32));
+
+    for (int i = 0; i < 6; i++)
+    {
+        int32* block = blocks + i * 64;
+
+        int32 dc;
+
+        if (version == 2) // fixed 10-bit DC
         {
-            putQuadRGB24(image, Yblk, *Crblk, *Cbblk);
-            putQuadRGB24(image + 8 * 3, Yblk + 64, *(Crblk + 4), *(Cbblk + 4));
+            dc = bs.getU(10);
+            if (dc >> 9)
+            {
+                dc -= 1024;
+            }
         }
+        else // variable DC bits
+        {
+            int32 ch = (i >= 2) ? 2 : i; // Cr, Cb, Y
+
+            dc = bs.getDC(i >= 2);
+
+            dc <<= 2;
+            dc += prev[ch];
+            prev[ch] = dc;
+            ASSERT(prev[ch] >= -512 && prev[ch] <= 511);
+        }
+
+        block[0] = SCALER(dc * MDEC_QTABLE[0], AAN_EXTRA - 3);
+
+        int32 used_col = 0;
+
+        int32 skip, ac;
+        int32 index = 0;
+        while (bs.readCode(skip, ac))
+        {
+            index += skip + 1;
+            ASSERT(index < 64);
+
+            block[MDEC_ZSCAN[index]] = SCALER(ac * MDEC_QTABLE[index] * qscale, AAN_EXTRA);
+
+            used_col |= (MDEC_ZSCAN[index] > 7) ? 1 << (MDEC_ZSCAN[index] & 7) : 0;
+        }
+
+        if (index == 0) used_col = -1;
+
+        used[i] = used_col;
     }
 }
 
-int32 mdec_decode(uint8* data, int32 version, int32 width, int32 height, int32 qscale, uint8* dst)
+void mdec_buildMacroblock(int32* blocks, const int32* used, uint8* dst, int32 stride)
 {
-    BitStream bs(data);
+    for (int32 i = 0; i < 6; i++)
+    {
+    #ifdef MDEC_SIMD
+        mdec_IDCT_SIMD(blocks + i * 64, used[i]);
+    #else
+        mdec_IDCT(blocks + i * 64, used[i]);
+    #endif
+    }
+
+#ifdef MDEC_SIMD
+    YUV2RGBA_SIMD(blocks, dst, stride);
+#else
+    YUV2RGBA(blocks, dst, stride);
+#endif
+}
+
+// returns the size of the consumed data
+int32 mdec_decode(const uint8* data, int32 size, int32 version, int32 width, int32 height, int32 qscale, uint8* dst)
+{
+    BitStream bs(data, size);
 
     int32 prev[3] = { 0, 0, 0 };
     int32 blocks[6][8 * 8]; // Cr, Cb, YTL, YTR, YBL, YBR
+    int32 used[6];
 
     for (int32 bX = 0; bX < width / 16; bX++)
     {
         for (int32 bY = 0; bY < height / 16; bY++)
         {
-            memset(blocks, 0, sizeof(blocks));
+            mdec_parseMacroblock(bs, prev, version, qscale, &blocks[0][0], used);
+            mdec_buildMacroblock(&blocks[0][0], used, dst + (width * bY * 16 + bX * 16) * 4, width * 4);
+        }
+    }
 
-            for (int i = 0; i < 6; i++)
-            {
-                int32* block = blocks[i];
-                
-                int32 dc;
+    return bs.getSize();
+}
 
-                if (version == 2) // fixed 10-bit DC
-                {
-                    dc = bs.getU(10);
-                    if (dc >> 9)
-                    {
-                        dc -= 1024;
-                    }
-                }
-                else // variable DC bits
-                {
-                    int32 nz = 0;
-                    while (bs.getBit())
-                        nz++;
-
-                    if (i >= 2) // Luma
-                    {
-                        if (nz == 0)
-                        {
-                            if (bs.getBit())
-                            {
-                                dc = bs.getS(2);
-                            }
-                            else
-                            {
-                                dc = (bs.getBit() << 1) - 1;
-                            }
-                        }
-                        else if (nz == 1)
-                        {
-                            dc = bs.getBit() ? bs.getS(3) : 0;
-                        }
-                        else
-                        {
-                            dc = bs.getS(nz + 2);
-                        }
-
-                        nz = 2;
-                    }
-                    else // Chroma
-                    {
-                        if (nz == 0)
-                        {
-                            if (bs.getBit())
-                            {
-                                dc = (bs.getBit() << 1) - 1;
-                            }
-                            else
-                            {
-                                dc = 0;
-                            }
-                        }
-                        else
-                        {
-                            dc = bs.getS(nz + 1);
-                        }
-
-                        nz = i;
-                    }
-
-                    dc <<= 2;
-                    dc += prev[nz];
-                    prev[nz] = dc;
-                    ASSERT(prev[nz] >= -512 && prev[nz] <= 511);
-                }
+// the bitstream is parsed on the caller thread into a ring of macroblock columns
+// while the workers run IDCT and colour conversion for the parsed columns
+#define MDEC_PIPE_COLUMNS   (MAX_WORKERS + 2)
 
-                block[0] = SCALER(dc * MDEC_QTABLE[0], AAN_EXTRA - 3);
+struct MDECPipe;
 
-                int32 used_col = 0;
+struct MDECColumn
+{
+    MDECPipe* pipe;
+    int32* blocks; // [height / 16][6][64]
+    int32* used;   // [height / 16][6]
+    int32 x;
+    bool busy;
+};
 
-                int32 skip, ac;
-                int32 index = 0;
-                while (bs.readCode(skip, ac))
-                {
-                    index += skip + 1;
-                    ASSERT(index < 64);
+struct MDECPipe
+{
+    Mutex mutex;
+    Condition ready;
+    MDECColumn columns[MDEC_PIPE_COLUMNS];
+    uint8* dst;
+    int32 width;
+    int32 height;
+};
 
-                    block[MDEC_ZSCAN[index]] = SCALER(ac * MDEC_QTABLE[index] * qscale, AAN_EXTRA);
+void mdec_buildColumn(void* param)
+{
+    MDECColumn* column = (MDECColumn*)param;
+    MDECPipe* pipe = column->pipe;
 
-                    used_col |= (MDEC_ZSCAN[index] > 7) ? 1 << (MDEC_ZSCAN[index] & 7) : 0;
-                }
+    int32 stride = pipe->width * 4;
+    uint8* dst = pipe->dst + column->x * 16 * 4;
 
-                if (index == 0) used_col = -1;
+    for (int32 bY = 0; bY < pipe->height / 16; bY++)
+    {
+        mdec_buildMacroblock(column->blocks + bY * 6 * 64, column->used + bY * 6, dst + bY * 16 * stride, stride);
+    }
 
-                mdec_IDCT(block, used_col);
-            }
+    pipe->mutex.lock();
+    column->busy = false;
+    pipe->ready.signal();
+    pipe->mutex.unlock();
+}
 
-            uint8 rgb[16 * 16 * 3];
-            YUV2RGB24(&blocks[0][0], (uint8*)rgb);
+// same as mdec_decode, single threaded if the pool has no workers
+int32 mdec_decodeParallel(const uint8* data, int32 size, int32 version, int32 width, int32 height, int32 qscale, uint8* dst, WorkerPool* pool)
+{
+    if (!pool->count)
+    {
+        return mdec_decode(data, size, version, width, height, qscale, dst);
+    }
 
-            uint8* src = rgb;
-            uint8* ptr = dst + (width * bY * 16 + bX * 16) * 4;
-            for (int y = 0; y < 16; y++)
-            {
-                for (int x = 0; x < 16; x++)
-                {
-                    *ptr++ = *src++;
-                    *ptr++ = *src++;
-                    *ptr++ = *src++;
-                    *ptr++ = 255;
-                }
-                ptr += (width - 16) * 4;
-            }
+    BitStream bs(data, size);
+
+    int32 prev[3] = { 0, 0, 0 };
+
+    int32 rows = height / 16;
+
+    MDECPipe pipe;
+    pipe.dst = dst;
+    pipe.width = width;
+    pipe.height = height;
+
+    int32* blocks = new int32[MDEC_PIPE_COLUMNS * rows * 6 * 64];
+    int32* used = new int32[MDEC_PIPE_COLUMNS * rows * 6];
+
+    for (int32 i = 0; i < MDEC_PIPE_COLUMNS; i++)
+    {
+        MDECColumn& column = pipe.columns[i];
+        column.pipe = &pipe;
+        column.blocks = blocks + i * rows * 6 * 64;
+        column.used = used + i * rows * 6;
+        column.busy = false;
+    }
+
+    for (int32 bX = 0; bX < width / 16; bX++)
+    {
+        MDECColumn& column = pipe.columns[bX % MDEC_PIPE_COLUMNS];
+
+        pipe.mutex.lock();
+        while (column.busy)
+        {
+            pipe.ready.wait(pipe.mutex);
         }
+        pipe.mutex.unlock();
+
+        for (int32 bY = 0; bY < rows; bY++)
+        {
+            mdec_parseMacroblock(bs, prev, version, qscale, column.blocks + bY * 6 * 64, column.used + bY * 6);
+        }
+
+        column.x = bX;
+        column.busy = true;
+        pool->push(mdec_buildColumn, &column);
     }
 
-    return (uint8*)bs.data - data;
+    pipe.mutex.lock();
+    for (int32 i = 0; i < MDEC_PIPE_COLUMNS; i++)
+    {
+        while (pipe.columns[i].busy)
+        {
+            pipe.ready.wait(pipe.mutex);
+        }
+    }
+    pipe.mutex.unlock();
+
+    delete[] blocks;
+    delete[] used;
+
+    return bs.getSize();
 }
 
 #endif
@@ -0,0 +1,1229 @@
+// asset decoding benchmark, run from the game data directory
+// times the decoders over every asset found, the types without game data use generated streams
+// usage: bench [-iterations N] [-synthetic] [-type ADT|MDEC|BSS_TIM|TIM|EMD|RDT]
+// output: csv line per asset type, the decoding times are in microseconds
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "os.h"
+
+int32 gPad;
+int32 gPadStickX;
+int32 gPadStickY;
+
+int32 gFrameIndex;
+int32 gLastFrameIndex;
+
+#define BENCH_ITERATIONS    16
+#define BENCH_SYNTH_ASSETS  8       // generated assets per type
+#define MAX_BENCH_ASSETS    4096    // per type
+#define MAX_BENCH_FILES     1024
+#define BENCH_MAX_CLUTS     4       // MAX_CLUTS of the renderer
+#define BSS_SECTION_SIZE    (64 << 10)
+
+enum AssetType
+{
+    ASSET_ADT,      // unpackImage
+    ASSET_MDEC,     // mdec_decode
+    ASSET_BSS_TIM,  // bss_tim_re2
+    ASSET_TIM,      // Texture::loadData
+    ASSET_EMD,      // Model::loadData
+    ASSET_RDT,      // Room::loadRDT
+    ASSET_MAX
+};
+
+const char* gAssetNames[ASSET_MAX] = { "ADT", "MDEC", "BSS_TIM", "TIM", "EMD", "RDT" };
+
+struct Asset
+{
+    const uint8* data;
+    int32 size;
+    int32 version;  // MDEC only
+    int32 qscale;
+    uint8* source;  // decoded data of the generated asset to verify the decoder, NULL for the game data
+    int32 sourceSize;
+};
+
+Asset gAssets[ASSET_MAX][MAX_BENCH_ASSETS];
+int32 gAssetsCount[ASSET_MAX];
+bool gSynthetic[ASSET_MAX];
+
+MmapStream* gBenchFiles[MAX_BENCH_FILES]; // mapped game data
+int32 gBenchFilesCount;
+uint8* gBenchHeap[ASSET_MAX * BENCH_SYNTH_ASSETS * 2]; // generated data
+int32 gBenchHeapCount;
+
+double benchTime()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000.0 + t.tv_nsec / 1000.0;
+}
+
+int cmpDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+struct Samples
+{
+    double* values;
+    int32 count;
+    int32 capacity;
+
+    void init()
+    {
+        values = NULL;
+        count = 0;
+        capacity = 0;
+    }
+
+    void free()
+    {
+        delete[] values;
+        init();
+    }
+
+    void add(double value)
+    {
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            double* data = new double[capacity];
+            if (values)
+            {
+                memcpy(data, values, count * sizeof(double));
+                delete[] values;
+            }
+            values = data;
+        }
+        values[count++] = value;
+    }
+};
+
+Asset* addAsset(AssetType type, const uint8* data, int32 size)
+{
+    if (gAssetsCount[type] == MAX_BENCH_ASSETS)
+        return NULL;
+
+    Asset* asset = gAssets[type] + gAssetsCount[type]++;
+    memset(asset, 0, sizeof(*asset));
+    asset->data = data;
+    asset->size = size;
+    return asset;
+}
+
+uint8* benchAlloc(int32 size)
+{
+    uint8* data = new uint8[size];
+    memset(data, 0, size);
+    gBenchHeap[gBenchHeapCount++] = data;
+    return data;
+}
+
+// game data ==============================================
+MmapStream* openBenchFile(const char* path)
+{
+    if (gBenchFilesCount == MAX_BENCH_FILES)
+        return NULL;
+
+    MmapStream* stream = new MmapStream(path);
+    if (!stream->isValid())
+    {
+        delete stream;
+        return NULL;
+    }
+
+    gBenchFiles[gBenchFilesCount++] = stream;
+    return stream;
+}
+
+void addRoomCut(const char* path)
+{
+    MmapStream* stream = openBenchFile(path);
+    if (!stream || stream->getSize() < 4)
+        return;
+
+    const uint8* data = stream->span(0, stream->getSize());
+    int32 count = *(const uint32*)data / 4;
+
+    for (int32 i = 0; i < count && (i + 1) * 4 <= stream->getSize(); i++)
+    {
+        int32 offset = ((const uint32*)data)[i];
+        int32 end = (i == count - 1) ? stream->getSize() : ((const uint32*)data)[i + 1];
+
+        if (offset < 0 || end > stream->getSize() || end - offset <= 4)
+            continue;
+
+        addAsset(ASSET_ADT, data + offset + 4, end - offset - 4); // skip magic
+    }
+}
+
+// the sections of the cameras are MDEC frames followed by the masks TIM
+void addBSS(const char* path, uint8* buffer)
+{
+    MmapStream* stream = openBenchFile(path);
+    if (!stream)
+        return;
+
+    const uint8* data = stream->span(0, stream->getSize());
+
+    for (int32 pos = 0; pos + 8 <= stream->getSize(); pos += BSS_SECTION_SIZE)
+    {
+        const uint16* header = (const uint16*)(data + pos);
+        if (header[1] != 0x3800)
+            continue;
+
+        int32 size = x_min(stream->getSize() - pos - 8, BSS_SECTION_SIZE);
+        const uint8* frame = data + pos + 8;
+
+        Asset* asset = addAsset(ASSET_MDEC, frame, size);
+        if (!asset)
+            return;
+        asset->qscale = header[2];
+        asset->version = header[3];
+
+        // same masks search as loadBackgroundBSS
+        int32 maskOffset = mdec_decode(frame, size, asset->version, BG_WIDTH, BG_HEIGHT, asset->qscale, buffer) + 3;
+        while (maskOffset + 3 <= size)
+        {
+            uint32 mask = frame[maskOffset + 1] | (frame[maskOffset + 2] << 8);
+            if ((frame[maskOffset] == 0) && (mask == 0xFFFF || mask == 0x0000))
+                break;
+            maskOffset++;
+        }
+        maskOffset -= 3;
+
+        if (maskOffset + 6 <= size && *(const uint16*)(frame + maskOffset + 4) == 0xFFFF)
+        {
+            addAsset(ASSET_BSS_TIM, frame + maskOffset, size - maskOffset);
+        }
+    }
+}
+
+// 8-bit TIMs with the palettes only, the textures of the models
+void addTIM(const char* path)
+{
+    MmapStream* stream = openBenchFile(path);
+    if (!stream || stream->getSize() < 20)
+        return;
+
+    const uint8* data = stream->span(0, stream->getSize());
+    const uint32* header = (const uint32*)data;
+    int32 count = *(const uint16*)(data + 18);
+
+    if (header[0] == 0x10 && header[1] == 9 && count > 0 && count <= BENCH_MAX_CLUTS)
+    {
+        addAsset(ASSET_TIM, data, stream->getSize());
+    }
+}
+
+void addDataFile(AssetType type, const char* path)
+{
+    MmapStream* stream = openBenchFile(path);
+    if (stream)
+    {
+        addAsset(type, stream->span(0, stream->getSize()), stream->getSize());
+    }
+}
+
+void addGameData()
+{
+    uint8* buffer = new uint8[BG_WIDTH * BG_HEIGHT * 4];
+
+    for (int32 i = 0; i < gFilesCount; i++)
+    {
+        const char* path = gFiles[i];
+        const char* name = strrchr(path, '/');
+        const char* ext = strrchr(path, '.');
+
+        name = name ? name + 1 : path;
+
+        if (!ext)
+            continue;
+
+        if (!strcasecmp(name, "ROOMCUT.BIN"))
+        {
+            addRoomCut(path);
+        }
+        else if (!strcasecmp(ext, ".BSS"))
+        {
+            addBSS(path, buffer);
+        }
+        else if (!strcasecmp(ext, ".TIM"))
+        {
+            addTIM(path);
+        }
+        else if (!strcasecmp(ext, ".EMD") || !strcasecmp(ext, ".PLD"))
+        {
+            addDataFile(ASSET_EMD, path);
+        }
+        else if (!strcasecmp(ext, ".RDT"))
+        {
+            addDataFile(ASSET_RDT, path);
+        }
+    }
+
+    delete[] buffer;
+}
+
+// generated data =========================================
+struct BenchRandom
+{
+    uint32 seed;
+
+    uint32 next()
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    int32 range(int32 count)
+    {
+        return next() % count;
+    }
+};
+
+// MSB first bits of the bytes or of the 16-bit words
+struct BitWriter
+{
+    uint8* data;
+    int32 pos;
+    uint32 acc;
+    int32 bits;
+    int32 wordBits;
+
+    void init(uint8* dst, int32 wordSize)
+    {
+        data = dst;
+        pos = 0;
+        acc = 0;
+        bits = 0;
+        wordBits = wordSize;
+    }
+
+    void put(uint32 value, int32 count)
+    {
+        while (count--)
+        {
+            acc = (acc << 1) | ((value >> count) & 1);
+            if (++bits == wordBits)
+            {
+                flush();
+            }
+        }
+    }
+
+    // count of zero bits and the value with the top bit set
+    void putBitfield(int32 value)
+    {
+        int32 n = 0;
+        while ((value >> n) > 1)
+        {
+            n++;
+        }
+        put(0, n);
+        put(value, n + 1);
+    }
+
+    void flush()
+    {
+        if (!bits)
+            return;
+
+        acc <<= wordBits - bits;
+        if (wordBits == 16)
+        {
+            data[pos++] = acc & 0xFF; // little endian words
+            data[pos++] = acc >> 8;
+        }
+        else
+        {
+            data[pos++] = acc;
+        }
+        acc = 0;
+        bits = 0;
+    }
+};
+
+// tiles of the same colour with noise, packs like the prerendered backgrounds
+void genImage(uint16* dst, int32 width, int32 height, BenchRandom& rnd)
+{
+    uint16 colors[8];
+    for (int32 i = 0; i < 8; i++)
+    {
+        colors[i] = rnd.next() & 0x7FFF;
+    }
+
+    for (int32 y = 0; y < height; y++)
+    {
+        for (int32 x = 0; x < width; x++)
+        {
+            uint32 tile = ((x >> 3) * 7 + (y >> 3) * 13 + (x >> 5)) & 7;
+            uint16 value = colors[tile];
+
+            if (!(rnd.next() & 3))
+            {
+                value ^= rnd.next() & 0x0421;
+            }
+
+            *dst++ = value;
+        }
+    }
+}
+
+// 8-bit TIM with the palettes
+int32 genTIM(uint8* dst, int32 width, int32 height, int32 cluts, BenchRandom& rnd)
+{
+    uint8* ptr = dst;
+    int32 clutSize = cluts * 256 * 2;
+    int32 imageSize = width * height;
+
+    *(uint32*)ptr = 0x10; ptr += 4;
+    *(uint32*)ptr = 9; ptr += 4; // 8-bit, palette
+    *(uint32*)ptr = 12 + clutSize; ptr += 4;
+    *(uint16*)ptr = 0; ptr += 2;
+    *(uint16*)ptr = 0; ptr += 2;
+    *(uint16*)ptr = 256; ptr += 2;
+    *(uint16*)ptr = cluts; ptr += 2;
+
+    for (int32 i = 0; i < cluts * 256; i++, ptr += 2)
+    {
+        *(uint16*)ptr = rnd.next() & 0x7FFF;
+    }
+
+    *(uint32*)ptr = 12 + imageSize; ptr += 4;
+    *(uint16*)ptr = 0; ptr += 2;
+    *(uint16*)ptr = 0; ptr += 2;
+    *(uint16*)ptr = width / 2; ptr += 2; // in 16-bit words
+    *(uint16*)ptr = height; ptr += 2;
+
+    for (int32 y = 0; y < height; y++)
+    {
+        for (int32 x = 0; x < width; x++)
+        {
+            *ptr++ = ((x >> 2) ^ (y >> 2)) + (rnd.range(4) ? 0 : rnd.range(256));
+        }
+    }
+
+    return int32(ptr - dst);
+}
+
+// greedy LZ77 match search, the matches must be at least 3 bytes long
+struct MatchFinder
+{
+    enum { HASH_BITS = 13, CHAIN = 16 };
+
+    int32 head[1 << HASH_BITS];
+    int32* prev;
+
+    void init(int32 size)
+    {
+        memset(head, 0xFF, sizeof(head));
+        prev = new int32[size];
+    }
+
+    void free()
+    {
+        delete[] prev;
+    }
+
+    static uint32 hash(const uint8* p)
+    {
+        return ((p[0] << 8) ^ (p[1] << 4) ^ p[2]) & ((1 << HASH_BITS) - 1);
+    }
+
+    void insert(const uint8* data, int32 pos, int32 size)
+    {
+        if (pos + 3 > size)
+            return;
+        uint32 h = hash(data + pos);
+        prev[pos] = head[h];
+        head[h] = pos;
+    }
+
+    int32 find(const uint8* data, int32 pos, int32 size, int32 window, int32 maxLength, int32& distance)
+    {
+        if (pos + 3 > size)
+            return 0;
+
+        int32 best = 0;
+        int32 candidate = head[hash(data + pos)];
+        int32 limit = x_min(maxLength, size - pos);
+
+        for (int32 i = 0; i < CHAIN && candidate >= 0 && pos - candidate <= window; i++)
+        {
+            int32 length = 0;
+            while (length < limit && data[candidate + length] == data[pos + length])
+            {
+                length++;
+            }
+
+            if (length > best)
+            {
+                best = length;
+                distance = pos - candidate;
+            }
+
+            candidate = prev[candidate];
+        }
+
+        return best >= 3 ? best : 0;
+    }
+};
+
+// ADT stream with the fixed trees: 9-bit literals & match lengths, 4-bit offset classes
+int32 genADT(const uint8* src, int32 size, uint8* dst)
+{
+    enum { BLOCK_SYMBOLS = 0xFFFF, MIN_MATCH = 3, MAX_MATCH = 258 };
+
+    struct Token
+    {
+        uint16 symbol;
+        uint16 offset;
+    };
+
+    Token* tokens = new Token[BLOCK_SYMBOLS];
+
+    MatchFinder finder;
+    finder.init(size);
+
+    BitWriter bw;
+    bw.init(dst, 8);
+
+    int32 pos = 0;
+    while (pos < size)
+    {
+        int32 count = 0;
+        while (pos < size && count < BLOCK_SYMBOLS)
+        {
+            int32 distance;
+            int32 length = finder.find(src, pos, size, LZSS_WINDOW_MASK + 1, MAX_MATCH, distance);
+
+            if (length)
+            {
+                tokens[count].symbol = length + 0xFD;
+                tokens[count].offset = distance - 1;
+            }
+            else
+            {
+                tokens[count].symbol = src[pos];
+                length = 1;
+            }
+            count++;
+
+            while (length--)
+            {
+                finder.insert(src, pos++, size);
+            }
+        }
+
+        bw.put(count & 0xFF, 8);
+        bw.put(count >> 8, 8);
+
+        // tree1: symbols 0 & 9 with 1-bit codes
+        for (int32 i = 0, prev = 0; i < 16; i++)
+        {
+            int32 length = (i == 0 || i == 9) ? 1 : 0;
+            bw.put(length != prev, 1);
+            if (length != prev)
+            {
+                bw.putBitfield(length ^ prev);
+                prev = length;
+            }
+        }
+
+        // tree2: all the 512 symbols are 9 bits, the first delta is 9 and 511 zeros
+        bw.put(1, 1);
+        bw.putBitfield(1);
+        bw.put(1, 1); // symbol 9 of tree1
+        bw.putBitfield(511);
+
+        // tree3: 16 offset classes of 4 bits
+        bw.put(1, 1);
+        bw.putBitfield(4);
+        bw.put(0, 15);
+
+        for (int32 i = 0; i < count; i++)
+        {
+            bw.put(tokens[i].symbol, 9);
+
+            if (tokens[i].symbol < 256)
+                continue;
+
+            int32 offset = tokens[i].offset;
+            if (!offset)
+            {
+                bw.put(0, 4);
+                continue;
+            }
+
+            int32 numBits = 0;
+            while ((offset >> numBits) > 1)
+            {
+                numBits++;
+            }
+            bw.put(numBits + 1, 4);
+            bw.put(offset - (1 << numBits), numBits);
+        }
+    }
+
+    bw.put(0, 16);
+    bw.flush();
+
+    finder.free();
+    delete[] tokens;
+
+    return bw.pos;
+}
+
+// RE2 masks TIM compression, the matches are up to 2048 bytes back
+int32 genBSSTIM(const uint8* src, int32 size, uint8* dst)
+{
+    enum { WINDOW = 2048, MAX_MATCH = 273, MAX_LITERALS = 271 };
+
+    uint8* ptr = dst;
+    *(uint32*)ptr = size; ptr += 4;
+    *(uint16*)ptr = 0xFFFF; ptr += 2;
+
+    MatchFinder finder;
+    finder.init(size);
+
+    int32 pos = 0;
+    int32 literals = 0;
+
+    while (pos <= size)
+    {
+        int32 distance;
+        int32 length = (pos < size) ? finder.find(src, pos, size, WINDOW, MAX_MATCH, distance) : 0;
+
+        if (literals && (length || pos == size || literals == MAX_LITERALS))
+        {
+            const uint8* from = src + pos - literals;
+            if (literals < 16)
+            {
+                *ptr++ = 32 - literals;
+            }
+            else
+            {
+                *ptr++ = 0x10;
+                *ptr++ = literals - 16;
+            }
+            memcpy(ptr, from, literals);
+            ptr += literals;
+            literals = 0;
+        }
+
+        if (pos == size)
+            break;
+
+        if (length)
+        {
+            int32 offset = -distance;
+            int32 high = ((offset >> 8) + 8) << 5;
+
+            if (length < 18)
+            {
+                *ptr++ = high | (length - 3);
+                *ptr++ = offset & 0xFF;
+            }
+            else
+            {
+                *ptr++ = high | 0x0F;
+                *ptr++ = offset & 0xFF;
+                *ptr++ = length - 18;
+            }
+        }
+        else
+        {
+            length = 1;
+            literals++;
+        }
+
+        while (length--)
+        {
+            finder.insert(src, pos++, size);
+        }
+    }
+
+    *ptr++ = 0xFF;
+
+    finder.free();
+
+    return int32(ptr - dst);
+}
+
+// version 2 frame with fixed DC and the short AC codes of the low frequencies
+int32 genMDEC(uint8* dst, int32 width, int32 height, BenchRandom& rnd)
+{
+    static const struct { int32 skip, ac, code, length; } codes[] = {
+        { 0, 1, 0x3, 2 },   // 11s
+        { 1, 1, 0x3, 3 },   // 011s
+        { 0, 2, 0x4, 4 },   // 0100s
+        { 2, 1, 0x5, 4 },   // 0101s
+        { 0, 3, 0x5, 5 },   // 00101s
+        { 3, 1, 0x7, 5 },   // 00111s
+        { 4, 1, 0x6, 5 },   // 00110s
+    };
+
+    BitWriter bw;
+    bw.init(dst, 16);
+
+    int32 blocks = (width / 16) * (height / 16) * 6;
+
+    for (int32 i = 0; i < blocks; i++)
+    {
+        bw.put(rnd.range(512) - 256, 10);
+
+        int32 count = rnd.range(12);
+        int32 index = 0;
+
+        for (int32 j = 0; j < count; j++)
+        {
+            int32 skip = rnd.range(4) ? rnd.range(3) : rnd.range(12);
+            int32 ac = rnd.range(4) ? 1 + rnd.range(2) : 1 + rnd.range(64);
+
+            if (index + skip + 1 > 63)
+                break;
+            index += skip + 1;
+
+            int32 sign = rnd.range(2);
+
+            int32 k = 0;
+            while (k < COUNT(codes) && (codes[k].skip != skip || codes[k].ac != ac))
+            {
+                k++;
+            }
+
+            if (k < COUNT(codes))
+            {
+                bw.put(codes[k].code, codes[k].length);
+                bw.put(sign, 1);
+            }
+            else
+            {
+                bw.put(1, 6); // escape
+                bw.put((skip << 10) | ((sign ? -ac : ac) & 0x3FF), 16);
+            }
+        }
+
+        bw.put(2, 2); // end of block
+    }
+
+    bw.flush();
+
+    return bw.pos;
+}
+
+// meshes only, pairs of triangles & quads
+int32 genEMD(uint8* dst, BenchRandom& rnd)
+{
+    enum { MESHES = 24, COORDS = 48, PRIMS = 64 };
+
+    uint8* ptr = dst;
+
+    *(uint32*)ptr = 8; ptr += 4;   // offsets table
+    *(uint32*)ptr = 4; ptr += 4;   // offsets count
+    *(uint32*)ptr = 0; ptr += 4;   // animation
+    *(uint32*)ptr = 0; ptr += 4;   // skeleton
+    *(uint32*)ptr = 24; ptr += 4;  // mesh
+    *(uint32*)ptr = 0; ptr += 4;   // texture
+
+    *(uint32*)ptr = 0; ptr += 4;   // length
+    *(uint32*)ptr = 0; ptr += 4;   // unknown
+    *(uint32*)ptr = MESHES; ptr += 4;
+
+    uint32* headers = (uint32*)ptr;
+    uint8* base = ptr;
+    ptr += MESHES * 7 * sizeof(uint32);
+
+    for (int32 i = 0; i < MESHES; i++)
+    {
+        bool isQuad = (i & 1);
+        int32 primVerts = isQuad ? 4 : 3;
+        int32 tileSize = isQuad ? 16 : 12;
+
+        uint32* h = headers + i * 7;
+
+        h[0] = int32(ptr - base);
+        h[1] = COORDS;
+        for (int32 j = 0; j < COORDS; j++, ptr += 8)
+        {
+            int16* c = (int16*)ptr;
+            c[0] = (rnd.range(19) - 9) * 50;
+            c[1] = (rnd.range(19) - 9) * 50;
+            c[2] = (rnd.range(19) - 9) * 50;
+            c[3] = 0;
+        }
+
+        h[2] = int32(ptr - base);
+        h[3] = COORDS;
+        for (int32 j = 0; j < COORDS; j++, ptr += 8)
+        {
+            int16* n = (int16*)ptr;
+            n[0] = (rnd.range(5) - 2) * 1000;
+            n[1] = (rnd.range(5) - 2) * 1000;
+            n[2] = (rnd.range(5) - 2) * 1000;
+            n[3] = 0;
+        }
+
+        h[4] = int32(ptr - base);
+        h[5] = PRIMS;
+        for (int32 j = 0; j < PRIMS * primVerts * 2; j++, ptr += 2)
+        {
+            *(uint16*)ptr = rnd.range(COORDS);
+        }
+
+        h[6] = int32(ptr - base);
+        for (int32 j = 0; j < PRIMS * tileSize; j++)
+        {
+            *ptr++ = rnd.range(16) * 8;
+        }
+    }
+
+    return int32(ptr - dst);
+}
+
+// all the sections parsed by Room::loadRDT, the init script returns immediately
+int32 genRDT(uint8* dst, BenchRandom& rnd)
+{
+    enum { CAMERAS = 8, COLLISIONS = 48, SWITCHES = 32, FLOORS = 12, BLOCKS = 12, MASKS = 4, CHUNKS = 16 };
+
+    uint8* ptr = dst;
+
+    RDTHeader* header = (RDTHeader*)ptr;
+    ptr += sizeof(RDTHeader);
+    memset(header, 0, sizeof(*header));
+    header->cameras = CAMERAS;
+
+    RDTOffsets* offset = (RDTOffsets*)ptr;
+    ptr += sizeof(RDTOffsets);
+    memset(offset, 0, sizeof(*offset));
+
+    offset->samplesInfo = int32(ptr - dst);
+    for (int32 i = 0; i < MAX_SAMPLES * 4; i++)
+    {
+        *ptr++ = rnd.next();
+    }
+    offset->samplesVH = int32(ptr - dst);
+
+    offset->collision = int32(ptr - dst);
+    *(uint32*)ptr = 0; ptr += 4;
+    *(uint32*)ptr = COLLISIONS + 1; ptr += 4;
+    *(uint32*)ptr = 0; ptr += 4;
+    *(uint32*)ptr = 0; ptr += 4;
+    for (int32 i = 0; i < COLLISIONS; i++, ptr += 16)
+    {
+        int16* c = (int16*)ptr;
+        c[0] = rnd.range(32000);
+        c[1] = rnd.range(32000);
+        c[2] = 100 + rnd.range(2000);
+        c[3] = 100 + rnd.range(2000);
+        c[4] = rnd.range(16);
+        c[5] = rnd.range(4);
+        *(uint32*)(c + 6) = 1;
+    }
+
+    offset->cameras = int32(ptr - dst);
+    int32* maskOffsets[CAMERAS];
+    for (int32 i = 0; i < CAMERAS; i++)
+    {
+        *(uint16*)ptr = 0; ptr += 2;
+        *(uint16*)ptr = 0x6000; ptr += 2;
+        for (int32 j = 0; j < 6; j++, ptr += 4)
+        {
+            *(int32*)ptr = rnd.range(40000) - 20000;
+        }
+        maskOffsets[i] = (int32*)ptr;
+        *(int32*)ptr = -1; ptr += 4;
+    }
+
+    // masks of the even cameras
+    for (int32 i = 0; i < CAMERAS; i += 2)
+    {
+        *maskOffsets[i] = int32(ptr - dst);
+        *(uint16*)ptr = MASKS; ptr += 2;
+        *(uint16*)ptr = MASKS * CHUNKS; ptr += 2;
+
+        for (int32 j = 0; j < MASKS; j++, ptr += 8)
+        {
+            uint16* m = (uint16*)ptr;
+            m[0] = CHUNKS;
+            m[1] = 0;
+            m[2] = rnd.range(256);
+            m[3] = rnd.range(200);
+        }
+
+        for (int32 j = 0; j < MASKS * CHUNKS; j++)
+        {
+            *ptr++ = rnd.range(256);
+            *ptr++ = rnd.range(256);
+            *ptr++ = rnd.range(64);
+            *ptr++ = rnd.range(40);
+            *(uint16*)ptr = rnd.range(0x1000); ptr += 2;
+            *(uint16*)ptr = 16; ptr += 2;
+        }
+    }
+
+    offset->cameraSwitches = int32(ptr - dst);
+    for (int32 i = 0; i < SWITCHES; i++)
+    {
+        *ptr++ = 0;
+        *ptr++ = 0;
+        *ptr++ = i % CAMERAS;
+        *ptr++ = (i / CAMERAS) ? rnd.range(CAMERAS) : 0;
+        for (int32 j = 0; j < 8; j++, ptr += 2)
+        {
+            *(int16*)ptr = rnd.range(32000);
+        }
+    }
+    memset(ptr, 0xFF, 4);
+    ptr += 4;
+
+    offset->cameraLights = int32(ptr - dst);
+    for (int32 i = 0; i < CAMERAS * 40; i++)
+    {
+        *ptr++ = rnd.next();
+    }
+
+    offset->floors = int32(ptr - dst);
+    *(uint16*)ptr = FLOORS; ptr += 2;
+    for (int32 i = 0; i < FLOORS * 6; i++, ptr += 2)
+    {
+        *(uint16*)ptr = rnd.range(32000);
+    }
+
+    offset->blocks = int32(ptr - dst);
+    *(uint32*)ptr = BLOCKS; ptr += 4;
+    for (int32 i = 1; i < BLOCKS; i++, ptr += 12)
+    {
+        int16* b = (int16*)ptr;
+        b[0] = rnd.range(16000);
+        b[1] = rnd.range(16000);
+        b[2] = b[0] + 1 + rnd.range(16000);
+        b[3] = b[1] + 1 + rnd.range(16000);
+        b[4] = 0;
+        b[5] = 0;
+    }
+
+    offset->scriptInit = int32(ptr - dst);
+    *(uint16*)ptr = 2; ptr += 2; // one sub
+    *ptr++ = CMD_RET;
+    *ptr++ = 0;
+
+    return int32(ptr - dst);
+}
+
+void addSynthetic(AssetType type)
+{
+    gSynthetic[type] = true;
+
+    for (int32 i = 0; i < BENCH_SYNTH_ASSETS; i++)
+    {
+        BenchRandom rnd;
+        rnd.seed = 0x9E3779B9 * (i + 1) + type;
+
+        Asset* asset = NULL;
+
+        switch (type)
+        {
+            case ASSET_ADT:
+            {
+                int32 size = BG_WIDTH * 256 * 2;
+                uint8* image = benchAlloc(size);
+                genImage((uint16*)image, BG_WIDTH, 256, rnd);
+
+                uint8* data = benchAlloc(size * 2);
+                asset = addAsset(type, data, genADT(image, size, data));
+                asset->source = image;
+                asset->sourceSize = size;
+                break;
+            }
+
+            case ASSET_MDEC:
+            {
+                uint8* data = benchAlloc(BSS_SECTION_SIZE * 2);
+                asset = addAsset(type, data, genMDEC(data, BG_WIDTH, BG_HEIGHT, rnd));
+                asset->version = 2;
+                asset->qscale = 1 + rnd.range(4);
+                break;
+            }
+
+            case ASSET_BSS_TIM:
+            {
+                uint8* tim = benchAlloc(64 << 10);
+                int32 size = genTIM(tim, 128, 128, 1, rnd);
+
+                uint8* data = benchAlloc(size * 2);
+                asset = addAsset(type, data, genBSSTIM(tim, size, data));
+                asset->source = tim;
+                asset->sourceSize = size;
+                break;
+            }
+
+            case ASSET_TIM:
+            {
+                uint8* data = benchAlloc(128 << 10);
+                asset = addAsset(type, data, genTIM(data, 256, 256, BENCH_MAX_CLUTS, rnd));
+                break;
+            }
+
+            case ASSET_EMD:
+            {
+                uint8* data = benchAlloc(256 << 10);
+                asset = addAsset(type, data, genEMD(data, rnd));
+                break;
+            }
+
+            case ASSET_RDT:
+            {
+                uint8* data = benchAlloc(16 << 10);
+                asset = addAsset(type, data, genRDT(data, rnd));
+                break;
+            }
+
+            default : ASSERT(0);
+        }
+    }
+}
+
+// benchmark ==============================================
+void resetRoom()
+{
+    for (int32 i = 0; i < MAX_ENEMIES; i++)
+    {
+        if (room.enemies[i].active)
+        {
+            room.enemies[i].free();
+        }
+    }
+    memset(room.enemies, 0, sizeof(room.enemies));
+}
+
+// returns the decoding time in microseconds
+double decodeAsset(AssetType type, const Asset& asset, uint8* buffer)
+{
+    double start = benchTime();
+    double time = 0;
+
+    switch (type)
+    {
+        case ASSET_ADT:
+        {
+            unpackImage(asset.data, asset.size, buffer);
+            time = benchTime() - start;
+            break;
+        }
+
+        case ASSET_MDEC:
+        {
+            mdec_decode(asset.data, asset.size, asset.version, BG_WIDTH, BG_HEIGHT, asset.qscale, buffer);
+            time = benchTime() - start;
+            break;
+        }
+
+        case ASSET_BSS_TIM:
+        {
+            int32 size;
+            uint8* data = bss_tim_re2(asset.data, size);
+            time = benchTime() - start;
+            delete[] data;
+            break;
+        }
+
+        case ASSET_TIM:
+        {
+            MemoryStream stream((uint8*)asset.data, asset.size);
+            Texture texture;
+            int32 w, h;
+            uint8* data32 = texture.loadData(&stream, w, h);
+            time = benchTime() - start;
+            delete[] data32;
+            break;
+        }
+
+        case ASSET_EMD:
+        {
+            MemoryStream stream((uint8*)asset.data, asset.size);
+            Model* model = new Model();
+            model->loadData(&stream);
+            time = benchTime() - start;
+            model->freeData();
+            model->free();
+            delete model;
+            break;
+        }
+
+        case ASSET_RDT:
+        {
+            MemoryStream stream((uint8*)asset.data, asset.size);
+            room.loadRDT(&stream);
+            time = benchTime() - start;
+            resetRoom();
+            break;
+        }
+
+        default : ASSERT(0);
+    }
+
+    return time;
+}
+
+// checks the decoders by the generated data
+bool verifyAsset(AssetType type, const Asset& asset, uint8* buffer)
+{
+    switch (type)
+    {
+        case ASSET_ADT:
+        {
+            int32 size = unpackImage(asset.data, asset.size, buffer);
+            return size == asset.sourceSize && !memcmp(buffer, asset.source, size);
+        }
+
+        case ASSET_MDEC:
+        {
+            return mdec_decode(asset.data, asset.size, asset.version, BG_WIDTH, BG_HEIGHT, asset.qscale, buffer) == asset.size;
+        }
+
+        case ASSET_BSS_TIM:
+        {
+            int32 size;
+            uint8* data = bss_tim_re2(asset.data, size);
+            bool ok = data && size == asset.sourceSize && !memcmp(data, asset.source, size);
+            delete[] data;
+            return ok;
+        }
+
+        default : ;
+    }
+    return true;
+}
+
+void benchType(AssetType type, int32 iterations, uint8* buffer)
+{
+    int32 count = gAssetsCount[type];
+    if (!count)
+        return;
+
+    Samples samples;
+    samples.init();
+
+    for (int32 i = 0; i < count; i++)
+    {
+        const Asset& asset = gAssets[type][i];
+
+        if (gSynthetic[type] && !verifyAsset(type, asset, buffer))
+        {
+            fprintf(stderr, "%s: generated asset %d doesn't match the decoded one\n", gAssetNames[type], i);
+        }
+
+        decodeAsset(type, asset, buffer); // warm up
+
+        for (int32 j = 0; j < iterations; j++)
+        {
+            samples.add(decodeAsset(type, asset, buffer));
+        }
+    }
+
+    qsort(samples.values, samples.count, sizeof(double), cmpDouble);
+
+    printf("%s,%s,%d,%d,%.3f,%.3f,%.3f\n",
+        gAssetNames[type],
+        gSynthetic[type] ? "synthetic" : "data",
+        count,
+        samples.count,
+        samples.values[0],
+        samples.values[samples.count / 2],
+        samples.values[samples.count * 99 / 100]);
+
+    samples.free();
+}
+
+int main(int argc, char** argv)
+{
+    int32 iterations = BENCH_ITERATIONS;
+    bool synthetic = false;
+    int32 filter = -1;
+
+    for (int32 i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-iterations") && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-synthetic"))
+        {
+            synthetic = true;
+        }
+        else if (!strcmp(argv[i], "-type") && i + 1 < argc)
+        {
+            i++;
+            for (int32 j = 0; j < ASSET_MAX; j++)
+            {
+                if (!strcasecmp(argv[i], gAssetNames[j]))
+                {
+                    filter = j;
+                }
+            }
+        }
+    }
+
+    iterations = x_max(iterations, 1);
+
+    // model cache & workers are used by the enemies of the room init scripts
+    workers.init(getCPUCount() - 1);
+    modelCache.init();
+
+    if (!synthetic)
+    {
+        streamInit();
+        addGameData();
+    }
+
+    for (int32 i = 0; i < ASSET_MAX; i++)
+    {
+        if (!gAssetsCount[i] && (filter == -1 || filter == i))
+        {
+            addSynthetic(AssetType(i));
+        }
+    }
+
+    uint8* buffer = new uint8[MAX_BG_BUFFER_SIZE];
+
+    printf("type,source,assets,samples,min_us,median_us,p99_us\n");
+
+    for (int32 i = 0; i < ASSET_MAX; i++)
+    {
+        if (filter == -1 || filter == i)
+        {
+            benchType(AssetType(i), iterations, buffer);
+        }
+    }
+
+    delete[] buffer;
+
+    resetRoom();
+
+    for (int32 i = 0; i < gBenchFilesCount; i++)
+    {
+        delete gBenchFiles[i];
+    }
+
+    for (int32 i = 0; i < gBenchHeapCount; i++)
+    {
+        delete[] gBenchHeap[i];
+    }
+
+    modelCache.free();
+    workers.free();
+    streamFree();
+
+    return 0;
+}
@@ -0,0 +1,2 @@
+set -e
+clang++ -std=c++11 -O2 -fno-exceptions -fno-rtti -Wno-c++11-narrowing -Wno-invalid-source-encoding -DNDEBUG -DRENDER_NULL -D_POSIX_THREADS -D_POSIX_READER_WRITER_LOCKS -D__LINUX__=1 bench.cpp ../win/render.cpp -I../../ -o../../../bin/bench -lm -lpthread
@@ -0,0 +1,148 @@
+// simulation without the window, GPU & sound for the soak tests, bots and CI benchmarks
+// run from the game data directory
+// usage: headless [-ticks N] [-room stage room] [-record file] [-replay file]
+// the replay runs all the recorded ticks and ignores -ticks & -room
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "os.h"
+
+int32 gPad;
+int32 gPadStickX;
+int32 gPadStickY;
+
+int32 gFrameIndex;
+int32 gLastFrameIndex;
+
+#define HEADLESS_TICKS  3000 // 100 seconds of the game time
+
+int main(int argc, char **argv)
+{
+    int32 ticks = HEADLESS_TICKS;
+    int32 stageIndex = -1;
+    int32 roomIndex = 0;
+    const char* recordPath = NULL;
+    const char* replayPath = NULL;
+    const char* tracePath = NULL;
+    const char* countersPath = NULL;
+
+    for (int32 i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-ticks") && i + 1 < argc)
+        {
+            ticks = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-room") && i + 2 < argc)
+        {
+            stageIndex = atoi(argv[++i]);
+            roomIndex = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-record") && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-replay") && i + 1 < argc)
+        {
+            replayPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-trace") && i + 1 < argc)
+        {
+            tracePath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-counters") && i + 1 < argc)
+        {
+            countersPath = argv[++i];
+        }
+    }
+
+    gTimerStart = osGetSystemTimeMS();
+    srand(0); // the same simulation for every run
+
+    streamInit();
+    renderInit();
+    gameInit();
+
+    if (countersPath)
+    {
+        gCounters.open(countersPath);
+    }
+
+    if (replayPath)
+    {
+        if (!gameReplay(replayPath))
+        {
+            printf("can't load replay %s\n", replayPath);
+            gameFree();
+            renderFree();
+            streamFree();
+            return 1;
+        }
+        ticks = replay.header.ticksCount;
+    }
+    else
+    {
+        if (stageIndex >= 0)
+        {
+            gameLoadRoom(stageIndex, roomIndex);
+        }
+
+        if (recordPath && !gameRecord(recordPath))
+        {
+            printf("can't record replay %s\n", recordPath);
+            gameFree();
+            renderFree();
+            streamFree();
+            return 1;
+        }
+    }
+
+    gPadStickX = gPadStickY = 256;
+
+    int64 startTime = osGetTimeUS();
+    int32 maxTime = 0;
+
+    for (int32 i = 0; i < ticks; i++)
+    {
+        // the game time doesn't depend on the real one, a tick is 2 frames of 60 Hz
+        gLastFrameIndex = gFrameIndex;
+        gFrameIndex += 2;
+
+        int64 tickStart = osGetTimeUS();
+
+        gameTick();
+
+        int32 tickTime = int32(osGetTimeUS() - tickStart);
+        maxTime = x_max(maxTime, tickTime);
+
+        gCounters.endFrame(); // a row per tick
+    }
+
+    int64 time = osGetTimeUS() - startTime;
+    if (time < 1)
+    {
+        time = 1;
+    }
+
+    printf("ticks: %d time: %.1f ms ticks/s: %.0f avg: %.2f us max: %d us room: %d %d\n",
+        ticks,
+        time / 1000.0,
+        ticks * 1000000.0 / time,
+        ticks ? double(time) / ticks : 0.0,
+        maxTime,
+        room.stageIndex,
+        room.roomIndex);
+
+    if (tracePath)
+    {
+        PROFILE_DUMP(tracePath);
+    }
+
+    gameFree();
+    renderFree();
+    streamFree();
+
+    return 0;
+}
@@ -0,0 +1,3 @@
+set -e
+# extra compiler flags are passed through, e.g. ./build.sh -DUSE_PROFILER
+clang++ -std=c++11 -O2 -s -fno-exceptions -fno-rtti -ffunction-sections -fdata-sections -Wno-c++11-narrowing -Wl,--gc-sections -Wno-invalid-source-encoding -DNDEBUG -DRENDER_NULL -D_POSIX_THREADS -D_POSIX_READER_WRITER_LOCKS -D__LINUX__=1 headless.cpp ../win/render.cpp "$@" -I../../ -o../../../bin/headless -lm -lpthread
@@ -1,6 +1,10 @@
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <linux/input.h>
 #include <X11/Xutil.h>
@@ -20,6 +24,7 @@
 #include <GL/glx.h>
 
 #include "game.h"
+#include "os.h"
 
 int32 gPad;
 int32 gPadStickX;
@@ -33,16 +38,165 @@ bool isQuit;
 Display* dpy;
 Window wnd;
 
-// timing
-unsigned int gTimerStart;
+const char* gTracePath = PROFILE_DEFAULT_TRACE;
 
-uint32 osGetSystemTimeMS()
+// frame pacing
+enum FrameMode
 {
-    timeval t;
-    gettimeofday(&t, NULL);
-    return int(t.tv_sec * 1000 + t.tv_usec / 1000 - gTimerStart);
+    FRAME_VSYNC,    // waits for the swap, the GPU doesn't queue frames to keep the input latency stable
+    FRAME_CAP,      // sleeps until the deadline of the next frame
+    FRAME_UNCAPPED  // benchmark
+};
+
+#define FRAME_DEFAULT_FPS       60
+#define FRAME_STATS_SIZE        1024
+#define FRAME_STATS_INTERVAL    5000000 // us
+
+int cmpFrameTime(const void* a, const void* b)
+{
+    return *(const int32*)a - *(const int32*)b;
 }
 
+struct FrameScheduler
+{
+    FrameMode mode;
+    bool report;
+    int64 period;       // ns
+    timespec deadline;
+
+    int64 frameStart;   // us
+    int64 statsStart;
+    int32 times[FRAME_STATS_SIZE]; // frame times of the last frames in us
+    int32 framesCount;
+    int64 framesTime;
+    int64 workTime;
+    int32 minTime;
+    int32 maxTime;
+
+    void init(FrameMode frameMode, int32 fps, bool stats)
+    {
+        mode = frameMode;
+        report = stats || (mode == FRAME_UNCAPPED);
+        period = 1000000000LL / (fps > 0 ? fps : FRAME_DEFAULT_FPS);
+
+        if (!setSwapInterval(mode == FRAME_VSYNC ? 1 : 0) && mode == FRAME_VSYNC)
+        {
+            LOG("vsync is not supported, cap to %d fps\n", FRAME_DEFAULT_FPS);
+            mode = FRAME_CAP;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        frameStart = statsStart = osGetTimeUS();
+        resetStats();
+    }
+
+    void resetStats()
+    {
+        framesCount = 0;
+        framesTime = 0;
+        workTime = 0;
+        minTime = 0x7FFFFFFF;
+        maxTime = 0;
+    }
+
+    static bool setSwapInterval(int32 interval)
+    {
+        PFNGLXSWAPINTERVALEXTPROC glXSwapIntervalEXT = (PFNGLXSWAPINTERVALEXTPROC)glXGetProcAddress((GLubyte*)"glXSwapIntervalEXT");
+        if (glXSwapIntervalEXT)
+        {
+            glXSwapIntervalEXT(dpy, wnd, interval);
+            return true;
+        }
+
+        PFNGLXSWAPINTERVALMESAPROC glXSwapIntervalMESA = (PFNGLXSWAPINTERVALMESAPROC)glXGetProcAddress((GLubyte*)"glXSwapIntervalMESA");
+        if (glXSwapIntervalMESA)
+        {
+            return glXSwapIntervalMESA(interval) == 0;
+        }
+
+        PFNGLXSWAPINTERVALSGIPROC glXSwapIntervalSGI = (PFNGLXSWAPINTERVALSGIPROC)glXGetProcAddress((GLubyte*)"glXSwapIntervalSGI");
+        if (glXSwapIntervalSGI && interval > 0) // SGI doesn't allow to disable vsync
+        {
+            return glXSwapIntervalSGI(interval) == 0;
+        }
+
+        return false;
+    }
+
+    // called after the swap
+    void wait()
+    {
+        int64 workEnd = osGetTimeUS();
+
+        if (mode == FRAME_VSYNC)
+        {
+            glFinish();
+        }
+        else if (mode == FRAME_CAP)
+        {
+            deadline.tv_nsec += period;
+            while (deadline.tv_nsec >= 1000000000)
+            {
+                deadline.tv_nsec -= 1000000000;
+                deadline.tv_sec++;
+            }
+
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+
+            int64 delta = int64(deadline.tv_sec - now.tv_sec) * 1000000000 + (deadline.tv_nsec - now.tv_nsec);
+
+            if (delta > 0)
+            {
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+            }
+            else if (delta < -period) // too late, don't try to catch up
+            {
+                deadline = now;
+            }
+        }
+
+        int64 frameEnd = osGetTimeUS();
+        int32 frameTime = int32(frameEnd - frameStart);
+
+        times[framesCount % FRAME_STATS_SIZE] = frameTime;
+        framesCount++;
+        framesTime += frameTime;
+        workTime += workEnd - frameStart;
+        minTime = x_min(minTime, frameTime);
+        maxTime = x_max(maxTime, frameTime);
+
+        frameStart = frameEnd;
+
+        if (frameEnd - statsStart >= FRAME_STATS_INTERVAL)
+        {
+            if (report)
+            {
+                printStats(frameEnd - statsStart);
+            }
+            statsStart = frameEnd;
+            resetStats();
+        }
+    }
+
+    void printStats(int64 interval)
+    {
+        int32 count = x_min(framesCount, FRAME_STATS_SIZE);
+        qsort(times, count, sizeof(times[0]), cmpFrameTime);
+
+        printf("frames: %d fps: %.1f avg: %.2f ms min: %.2f ms max: %.2f ms p99: %.2f ms work: %.2f ms\n",
+            framesCount,
+            framesCount * 1000000.0 / interval,
+            framesTime / 1000.0 / framesCount,
+            minTime / 1000.0,
+            maxTime / 1000.0,
+            times[count * 99 / 100] / 1000.0,
+            workTime / 1000.0 / framesCount);
+    }
+};
+
+FrameScheduler frameScheduler;
+
 void osQuit()
 {
     isQuit = true;
@@ -453,78 +607,20 @@ void WndProc(const XEvent& e, Display* dpy, Window wnd)
                 toggle_fullscreen(dpy, wnd);
                 break;
             }
-            setDown(keyToInputKey(dpy, e.xkey), e.type == KeyPress);
-            break;
-        }
-    }
-}
-
-#define MAX_FILES 4096
-char* gFiles[MAX_FILES];
-int32 gFilesCount;
-
-void addDir(char* path)
-{
-    dirent* e;
-    DIR* dir = opendir(path);
-
-    int32 pathLen = strlen(path);
-    path[pathLen] = '/';
-
-    while ((e = readdir(dir)))
-    {
-        if (e->d_type == DT_DIR)
-        {
-            if (e->d_name[0] != '.')
+            if (e.type == KeyPress && XLookupKeysym((XKeyEvent*)&e.xkey, 0) == XK_F8)
             {
-                strcpy(path + 1 + pathLen, e->d_name);
-                addDir(path);
+                gOverlay = !gOverlay;
+                break;
             }
-        }
-        else
-        {
-            ASSERT(gFilesCount < MAX_FILES);
-            if (gFilesCount < MAX_FILES)
+            if (e.type == KeyPress && XLookupKeysym((XKeyEvent*)&e.xkey, 0) == XK_F9)
             {
-                strcpy(path + 1 + pathLen, e->d_name);
-                char* fileName = new char[strlen(path) + 1 - 2];
-                gFiles[gFilesCount++] = strcpy(fileName, path + 2);
+                PROFILE_DUMP(gTracePath);
+                break;
             }
+            setDown(keyToInputKey(dpy, e.xkey), e.type == KeyPress);
+            break;
         }
     }
-
-    path[pathLen] = '\0';
-}
-
-void streamInit()
-{
-    char path[1024];
-    strcpy(path, ".");
-    addDir(path);
-    LOG("scan %d files\n", gFilesCount);
-}
-
-void streamFree()
-{
-    for (int32 i = 0; i < gFilesCount; i++)
-    {
-        delete[] gFiles[i];
-    }
-}
-
-FileStream::FileStream(const char* fileName)
-{
-    for (int32 i = 0; i < gFilesCount; i++)
-    {
-        if (!strcasecmp(fileName, gFiles[i]))
-        {
-            LOG("open file %s -> %s\n", fileName, gFiles[i]);
-            f = fopen(gFiles[i], "rb");
-            return;
-        }
-    }
-    LOG("file not found %s\n", fileName);
-    f = NULL;
 }
 
 int main(int argc, char **argv)
@@ -565,15 +661,85 @@ int main(int argc, char **argv)
     gTimerStart = osGetSystemTimeMS();
     srand(gTimerStart);
 
+    // -vsync (default), -fps <N> or -uncapped, -stats prints the frame times
+    // -record <file> saves the input log, -replay <file> plays it and quits
+    // -trace <file> sets the path of the profiler trace saved by F9 and on exit
+    // -overlay shows the performance counters (F8), -counters <file> saves them every frame
+    FrameMode frameMode = FRAME_VSYNC;
+    int32 fps = FRAME_DEFAULT_FPS;
+    bool stats = false;
+    const char* recordPath = NULL;
+    const char* replayPath = NULL;
+    bool trace = false;
+    const char* countersPath = NULL;
+
+    for (int32 i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-vsync"))
+        {
+            frameMode = FRAME_VSYNC;
+        }
+        else if (!strcmp(argv[i], "-fps") && i + 1 < argc)
+        {
+            frameMode = FRAME_CAP;
+            fps = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-uncapped"))
+        {
+            frameMode = FRAME_UNCAPPED;
+        }
+        else if (!strcmp(argv[i], "-stats"))
+        {
+            stats = true;
+        }
+        else if (!strcmp(argv[i], "-record") && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-replay") && i + 1 < argc)
+        {
+            replayPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-trace") && i + 1 < argc)
+        {
+            gTracePath = argv[++i];
+            trace = true;
+        }
+        else if (!strcmp(argv[i], "-overlay"))
+        {
+            gOverlay = true;
+        }
+        else if (!strcmp(argv[i], "-counters") && i + 1 < argc)
+        {
+            countersPath = argv[++i];
+        }
+    }
+
     streamInit();
     inputInit();
     soundInit();
     renderInit();
     gameInit();
 
+    if (countersPath)
+    {
+        gCounters.open(countersPath);
+    }
+
+    if (replayPath && !gameReplay(replayPath))
+    {
+        osQuit();
+    }
+    else if (recordPath && !gameRecord(recordPath))
+    {
+        osQuit();
+    }
+
+    frameScheduler.init(frameMode, fps, stats);
+
     while (!isQuit)
     {
-        if (XPending(dpy))
+        while (XPending(dpy))
         {
             XEvent event;
             XNextEvent(dpy, &event);
@@ -583,20 +749,33 @@ int main(int argc, char **argv)
             }
             WndProc(event, dpy, wnd);
         }
-        else
-        {
-            gLastFrameIndex = gFrameIndex;
-            gFrameIndex = osGetSystemTimeMS() * 60 / 1000;
 
-            inputUpdate();
+        if (isQuit)
+            break;
+
+        gLastFrameIndex = gFrameIndex;
+        gFrameIndex = osGetSystemTimeMS() * 60 / 1000;
+
+        inputUpdate();
+
+        gameUpdate();
+        gameRender();
+
+        renderSwap();
 
-            gameUpdate();
-            gameRender();
+        frameScheduler.wait();
 
-            renderSwap();
+        if (replay.isFinished())
+        {
+            osQuit();
         }
     };
 
+    if (trace)
+    {
+        PROFILE_DUMP(gTracePath);
+    }
+
     gameFree();
     renderFree();
     soundFree();
@@ -0,0 +1,359 @@
+#ifndef H_OS
+#define H_OS
+
+// timing & file access shared by the posix targets
+
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common.h"
+
+// timing
+unsigned int gTimerStart;
+
+uint32 osGetSystemTimeMS()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return uint32(t.tv_sec * 1000 + t.tv_nsec / 1000000 - gTimerStart);
+}
+
+int64 osGetTimeUS()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64(t.tv_sec) * 1000000 + t.tv_nsec / 1000;
+}
+
+#define MAX_FILES           4096
+#define MAX_DIRS            1024
+#define FILES_HASH_SIZE     8192 // power of two, at least twice the MAX_FILES
+#define FILES_CACHE_NAME    ".files.cache"
+#define FILES_CACHE_MAGIC   "OpenResident files 1"
+
+char* gFiles[MAX_FILES];
+int32 gFilesCount;
+int16 gFilesHash[FILES_HASH_SIZE]; // file index + 1, 0 - empty slot
+
+struct DirInfo
+{
+    char* path;
+    int64 mtime;
+} gDirs[MAX_DIRS];
+int32 gDirsCount;
+
+// case insensitive FNV-1a
+uint32 fileHash(const char* name)
+{
+    uint32 hash = 2166136261u;
+    while (*name)
+    {
+        char c = *name++;
+        if (c >= 'A' && c <= 'Z')
+        {
+            c += 'a' - 'A';
+        }
+        hash = (hash ^ uint8(c)) * 16777619u;
+    }
+    return hash;
+}
+
+int32 findFile(const char* name)
+{
+    uint32 i = fileHash(name);
+    while (1)
+    {
+        i &= FILES_HASH_SIZE - 1;
+
+        int32 index = gFilesHash[i] - 1;
+
+        if (index < 0)
+            return -1;
+
+        if (!strcasecmp(name, gFiles[index]))
+            return index;
+
+        i++;
+    }
+}
+
+void addFile(const char* name)
+{
+    ASSERT(gFilesCount < MAX_FILES);
+    if (gFilesCount >= MAX_FILES)
+        return;
+
+    // keep the first one of the names that differ by case only
+    uint32 i = fileHash(name);
+    while (1)
+    {
+        i &= FILES_HASH_SIZE - 1;
+
+        int32 index = gFilesHash[i] - 1;
+
+        if (index < 0)
+            break;
+
+        if (!strcasecmp(name, gFiles[index]))
+            return;
+
+        i++;
+    }
+
+    gFiles[gFilesCount] = strcpy(new char[strlen(name) + 1], name);
+    gFilesHash[i] = ++gFilesCount;
+}
+
+int64 getDirTime(const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return -1;
+    return int64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+int64 osGetFileTime(const char* path)
+{
+    int32 index = findFile(path);
+    if (index < 0)
+        return -1;
+    return getDirTime(gFiles[index]);
+}
+
+// the file index isn't updated, the saved file is found by the next run after the rescan
+bool osSaveFile(const char* path, const void* data, int32 size)
+{
+    char dir[256];
+    if (strlen(path) >= sizeof(dir))
+        return false;
+    strcpy(dir, path);
+    char* sep = strrchr(dir, '/');
+    if (sep)
+    {
+        *sep = '\0';
+        mkdir(dir, 0755);
+    }
+
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(data, 1, size, f) == size_t(size);
+    fclose(f);
+
+    if (!ok)
+    {
+        remove(path);
+    }
+
+    return ok;
+}
+
+void addDir(char* path)
+{
+    dirent* e;
+    DIR* dir = opendir(path);
+    if (!dir)
+        return;
+
+    ASSERT(gDirsCount < MAX_DIRS);
+    if (gDirsCount < MAX_DIRS)
+    {
+        DirInfo& info = gDirs[gDirsCount++];
+        info.path = strcpy(new char[strlen(path) + 1], path);
+        info.mtime = getDirTime(path);
+    }
+
+    int32 pathLen = strlen(path);
+    path[pathLen] = '/';
+
+    while ((e = readdir(dir)))
+    {
+        if (e->d_type == DT_DIR)
+        {
+            if (e->d_name[0] != '.')
+            {
+                strcpy(path + 1 + pathLen, e->d_name);
+                addDir(path);
+            }
+        }
+        else
+        {
+            strcpy(path + 1 + pathLen, e->d_name);
+            if (strcmp(path, "./" FILES_CACHE_NAME))
+            {
+                addFile(path + 2);
+            }
+        }
+    }
+
+    path[pathLen] = '\0';
+
+    closedir(dir);
+}
+
+void streamFree()
+{
+    for (int32 i = 0; i < gFilesCount; i++)
+    {
+        delete[] gFiles[i];
+    }
+
+    for (int32 i = 0; i < gDirsCount; i++)
+    {
+        delete[] gDirs[i].path;
+    }
+
+    gFilesCount = 0;
+    gDirsCount = 0;
+    memset(gFilesHash, 0, sizeof(gFilesHash));
+}
+
+// the cache is valid while the mtimes of all the scanned directories are the same
+bool streamLoadCache()
+{
+    FILE* f = fopen(FILES_CACHE_NAME, "rb");
+    if (!f)
+        return false;
+
+    char line[1024];
+    bool valid = fgets(line, sizeof(line), f) && !strcmp(line, FILES_CACHE_MAGIC "\n");
+
+    while (valid && fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\n")] = '\0';
+
+        if (line[0] == 'D')
+        {
+            long long mtime;
+            int32 offset;
+            if (sscanf(line, "D %lld %n", &mtime, &offset) != 1 || getDirTime(line + offset) != mtime)
+            {
+                valid = false;
+            }
+        }
+        else if (line[0] == 'F' && line[1] == ' ')
+        {
+            addFile(line + 2);
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    fclose(f);
+
+    if (!valid)
+    {
+        streamFree();
+    }
+
+    return valid;
+}
+
+void streamSaveCache(FILE* f)
+{
+    fprintf(f, "%s\n", FILES_CACHE_MAGIC);
+
+    for (int32 i = 0; i < gDirsCount; i++)
+    {
+        fprintf(f, "D %lld %s\n", (long long)gDirs[i].mtime, gDirs[i].path);
+    }
+
+    for (int32 i = 0; i < gFilesCount; i++)
+    {
+        fprintf(f, "F %s\n", gFiles[i]);
+    }
+}
+
+void streamInit()
+{
+    if (streamLoadCache())
+    {
+        LOG("cached %d files\n", gFilesCount);
+        return;
+    }
+
+    // create the cache file before the scan to keep the root directory mtime
+    FILE* cache = fopen(FILES_CACHE_NAME, "wb");
+
+    char path[1024];
+    strcpy(path, ".");
+    addDir(path);
+    LOG("scan %d files\n", gFilesCount);
+
+    if (cache)
+    {
+        streamSaveCache(cache);
+        fclose(cache);
+    }
+}
+
+FileStream::FileStream(const char* fileName)
+{
+    int32 index = findFile(fileName);
+    if (index >= 0)
+    {
+        LOG("open file %s -> %s\n", fileName, gFiles[index]);
+        f = fopen(gFiles[index], "rb");
+        return;
+    }
+    LOG("file not found %s\n", fileName);
+    f = NULL;
+}
+
+MmapStream::MmapStream(const char* fileName) : MemoryStream(NULL, 0), handle(NULL), mapped(false)
+{
+    int32 index = findFile(fileName);
+    if (index < 0)
+    {
+        LOG("file not found %s\n", fileName);
+        return;
+    }
+
+    LOG("map file %s -> %s\n", fileName, gFiles[index]);
+
+    int fd = open(gFiles[index], O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED)
+        {
+            setData((uint8*)ptr, (int32)st.st_size);
+            mapped = true;
+        }
+    }
+
+    close(fd);
+
+    if (!mapped)
+    {
+        loadHeap(gFiles[index]);
+    }
+}
+
+MmapStream::~MmapStream()
+{
+    if (mapped)
+    {
+        munmap(data, size);
+    }
+    else
+    {
+        delete[] data;
+    }
+}
+
+#endif
@@ -30,6 +30,49 @@ uint32 osGetSystemTimeMS()
     return (uint32)((count.QuadPart - gTimerStart.QuadPart) * 1000L / gTimerFreq.QuadPart);
 }
 
+int64 osGetTimeUS()
+{
+    LARGE_INTEGER count;
+    QueryPerformanceCounter(&count);
+    return int64(count.QuadPart / gTimerFreq.QuadPart) * 1000000 + int64(count.QuadPart % gTimerFreq.QuadPart) * 1000000 / gTimerFreq.QuadPart;
+}
+
+int64 osGetFileTime(const char* path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info))
+        return -1;
+    return (int64(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+}
+
+bool osSaveFile(const char* path, const void* data, int32 size)
+{
+    char dir[256];
+    if (strlen(path) >= sizeof(dir))
+        return false;
+    strcpy(dir, path);
+    char* sep = strrchr(dir, '/');
+    if (sep)
+    {
+        *sep = '\0';
+        CreateDirectoryA(dir, NULL);
+    }
+
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(data, 1, size, f) == size_t(size);
+    fclose(f);
+
+    if (!ok)
+    {
+        remove(path);
+    }
+
+    return ok;
+}
+
 void osQuit()
 {
     PostQuitMessage(0);
@@ -422,6 +465,20 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
                 }
             }
 
+            // F8 - show the performance counters
+            if (msg == WM_KEYDOWN && wParam == VK_F8)
+            {
+                gOverlay = !gOverlay;
+                break;
+            }
+
+            // F9 - save the profiler trace
+            if (msg == WM_KEYDOWN && wParam == VK_F9)
+            {
+                PROFILE_DUMP(PROFILE_DEFAULT_TRACE);
+                break;
+            }
+
             setKey(wParam, (msg == WM_KEYDOWN) || (msg == WM_SYSKEYDOWN));
             break;
 
@@ -446,6 +503,53 @@ FileStream::FileStream(const char* fileName)
     f = fopen(fileName, "rb");
 }
 
+MmapStream::MmapStream(const char* fileName) : MemoryStream(NULL, 0), handle(NULL), mapped(false)
+{
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    DWORD fileSize = GetFileSize(file, NULL);
+    if (fileSize != INVALID_FILE_SIZE && fileSize > 0)
+    {
+        handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (handle)
+        {
+            uint8* ptr = (uint8*)MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+            if (ptr)
+            {
+                setData(ptr, (int32)fileSize);
+                mapped = true;
+            }
+            else
+            {
+                CloseHandle(handle);
+                handle = NULL;
+            }
+        }
+    }
+
+    CloseHandle(file);
+
+    if (!mapped)
+    {
+        loadHeap(fileName);
+    }
+}
+
+MmapStream::~MmapStream()
+{
+    if (mapped)
+    {
+        UnmapViewOfFile(data);
+        CloseHandle(handle);
+    }
+    else
+    {
+        delete[] data;
+    }
+}
+
 #define WND_WIDTH 960
 #define WND_HEIGHT 720
 
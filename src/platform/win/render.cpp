@@ -1,8 +1,13 @@
 #include <math.h>
 
 #include "render.h"
+#include "pose.h"
+#include "profiler.h"
+#include "counters.h"
 
-#ifdef __WIN32__
+#ifdef RENDER_NULL
+    typedef unsigned int GLuint; // resource handles of the null backend
+#elif __WIN32__
     #include <windows.h>
     #include <gl/GL.h>
     #include <gl/glu.h>
@@ -26,7 +31,9 @@
 #define PROJ_Z_CLIP     ((PROJ_Z_NEAR + PROJ_Z_FAR) / (PROJ_Z_NEAR - PROJ_Z_FAR))
 #define PROJ_W_CLIP     (2.0f * PROJ_Z_FAR * PROJ_Z_NEAR / (PROJ_Z_NEAR - PROJ_Z_FAR))
 
-#ifdef __WIN32__
+#ifdef RENDER_NULL
+    // no window
+#elif __WIN32__
     extern HWND hWnd;
     HDC hDC;
     HGLRC hRC;
@@ -37,6 +44,9 @@
 
 int32 gWidth, gHeight;
 
+Counters gCounters;
+
+#ifndef RENDER_NULL
 // Textures
 PFNGLGENERATEMIPMAPPROC             glGenerateMipmap;
 // Shader
@@ -73,6 +83,12 @@ PFNGLBUFFERSUBDATAARBPROC           glBufferSubData;
 PFNGLGENVERTEXARRAYSPROC            glGenVertexArrays;
 PFNGLDELETEVERTEXARRAYSPROC         glDeleteVertexArrays;
 PFNGLBINDVERTEXARRAYPROC            glBindVertexArray;
+// Instancing
+PFNGLDRAWELEMENTSINSTANCEDPROC      glDrawElementsInstanced;
+PFNGLGETUNIFORMBLOCKINDEXPROC       glGetUniformBlockIndex;
+PFNGLUNIFORMBLOCKBINDINGPROC        glUniformBlockBinding;
+PFNGLBINDBUFFERRANGEPROC            glBindBufferRange;
+#endif
 
 // vectors =============================================
 struct vec3
@@ -228,24 +244,11 @@ struct mat4
 mat4 gViewProjMatrix;
 mat4 gModelMatrix;
 
-mat4 gMatrixStack[8];
-mat4* gMatrixPtr = gMatrixStack;
-
 // lighting
 vec4 gAmbient;
 vec4 gLightColor[MAX_LIGHTS];
 vec4 gLightPos[MAX_LIGHTS];
 
-void matrixPush()
-{
-    *gMatrixPtr++ = gModelMatrix;
-}
-
-void matrixPop()
-{
-    gModelMatrix = *--gMatrixPtr;
-}
-
 
 #ifdef _DEBUG
 void dumpBitmap(const char* fileName, int32 width, int32 height, uint8* data32)
@@ -325,16 +328,18 @@ enum UniformType
     uMAX
 };
 
+#ifndef RENDER_NULL
 struct Shader
 {
     GLuint id;
     GLint uid[uMAX];
 
-    void setMatrix(UniformType type, const mat4* m)
+    void setMatrix(UniformType type, const mat4* m, int32 count = 1)
     {
         if (uid[type] != -1)
         {
-            glUniformMatrix4fv(uid[type], 1, GL_FALSE, (GLfloat*)m);
+            glUniformMatrix4fv(uid[type], count, GL_FALSE, (GLfloat*)m);
+            gCounters.add(CNT_UNIFORMS);
         }
     }
 
@@ -343,6 +348,7 @@ struct Shader
         if (uid[type] != -1)
         {
             glUniform4fv(uid[type], count, (GLfloat*)v);
+            gCounters.add(CNT_UNIFORMS);
         }
     }
 
@@ -374,8 +380,11 @@ const char* sh_model =
 
     "#ifdef VERTEX\n"
         "#define MAX_LIGHTS 3\n"
+        "#define MAX_JOINTS 256\n"
         "uniform mat4 uViewProjMatrix;\n"
-        "uniform mat4 uModelMatrix;\n"
+        "layout(std140) uniform Joints {\n"
+            "mat4 uJoints[MAX_JOINTS];\n"
+        "};\n"
         "uniform vec4 uTexParam;\n"
         "uniform vec4 uAmbient;\n"
         "uniform vec4 uLightColor[MAX_LIGHTS];\n"
@@ -389,8 +398,9 @@ const char* sh_model =
             "vTexCoord.x = aTexCoord.x * uTexParam.x + aTexCoord.z * uTexParam.z;\n"
             "vTexCoord.y = aTexCoord.y * uTexParam.y;\n"
 
-            "vec4 c = uModelMatrix * vec4(aCoord, 1.0);\n"
-            "vec4 n = uModelMatrix * vec4(aNormal.xyz, 0.0);\n"
+            "mat4 joint = uJoints[gl_InstanceID * int(uTexParam.w) + int(aTexCoord.w)];\n"
+            "vec4 c = joint * vec4(aCoord, 1.0);\n"
+            "vec4 n = joint * vec4(aNormal.xyz, 0.0);\n"
             "n = normalize(n);\n"
 
             "vec3 light = uAmbient.xyz;\n"
@@ -473,6 +483,36 @@ const char* sh_background_mask =
 
     "#endif\n";
 
+Shader shaderOverlay;
+
+const char* sh_overlay =
+    "varying vec2 vTexCoord;\n"
+    "varying vec4 vColor;\n"
+
+    "#ifdef VERTEX\n"
+        "uniform mat4 uViewProjMatrix;\n"
+        "uniform vec4 uTexParam;\n"
+
+        "attribute vec4 aCoord;\n"
+        "attribute vec4 aTexCoord;\n"
+        "attribute vec4 aColor;\n"
+
+        "void main() {\n"
+            "vTexCoord.xy = aTexCoord.xy * uTexParam.xy;\n"
+            "vColor = aColor;\n"
+            "gl_Position = uViewProjMatrix * aCoord;\n"
+        "}\n"
+
+    "#else\n"
+
+        "uniform sampler2D sDiffuse;\n"
+
+        "void main() {\n"
+            "fragColor = texture2D(sDiffuse, vTexCoord) * vColor;\n"
+        "}\n"
+
+    "#endif\n";
+
 
 #ifdef _DEBUG
 
@@ -572,15 +612,22 @@ void compileShader(Shader* shader, const char* text)
 
     shader->uid[uViewProjMatrix] = glGetUniformLocation(shader->id, "uViewProjMatrix");
     shader->uid[uModelMatrix] = glGetUniformLocation(shader->id, "uModelMatrix");
+
+    GLuint block = glGetUniformBlockIndex(shader->id, "Joints");
+    if (block != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(shader->id, block, 0);
+    }
     shader->uid[uTexParam] = glGetUniformLocation(shader->id, "uTexParam");
     shader->uid[uAmbient] = glGetUniformLocation(shader->id, "uAmbient");
     shader->uid[uLightColor] = glGetUniformLocation(shader->id, "uLightColor");
     shader->uid[uLightPos] = glGetUniformLocation(shader->id, "uLightPos");
 }
+#endif
 
 
 // texture ==============================================
-void Texture::load(Stream* stream)
+uint8* Texture::loadData(Stream* stream, int32& w, int32& h)
 {
     enum TextureFormat
     {
@@ -609,8 +656,8 @@ void Texture::load(Stream* stream)
     stream->skip(4); // texture size
     x = stream->s16();
     y = stream->s16();
-    int32 w = stream->s16();
-    int32 h = stream->s16();
+    w = stream->s16();
+    h = stream->s16();
 
     uint8* data = new uint8[w * h * sizeof(uint16)];
     stream->read(data, w * h * sizeof(uint16));
@@ -704,6 +751,16 @@ void Texture::load(Stream* stream)
         default: ASSERT(0);
     }
 
+    delete[] data;
+
+    return data32;
+}
+
+void Texture::load(Stream* stream)
+{
+    int32 w, h;
+    uint8* data32 = loadData(stream, w, h);
+
     init(data32, w, h);
 
 #if 0
@@ -715,7 +772,6 @@ void Texture::load(Stream* stream)
 #endif
 
     delete[] data32;
-    delete[] data;
 }
 
 void Texture::init(uint8* data32, int32 w, int32 h)
@@ -725,6 +781,9 @@ void Texture::init(uint8* data32, int32 w, int32 h)
         free();
     }
 
+    gCounters.add(CNT_TEXTURES);
+    gCounters.add(CNT_TEXTURE_BYTES, w * h * 4);
+
     if (!res)
     {
         width = w;
@@ -732,6 +791,7 @@ void Texture::init(uint8* data32, int32 w, int32 h)
 
         res = new GLuint();
 
+    #ifndef RENDER_NULL
         glGenTextures(1, (GLuint*)res);
         glBindTexture(GL_TEXTURE_2D, *(GLuint*)res);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data32);
@@ -740,24 +800,31 @@ void Texture::init(uint8* data32, int32 w, int32 h)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    #endif
     }
     else
     {
+    #ifndef RENDER_NULL
         glBindTexture(GL_TEXTURE_2D, *(GLuint*)res);
         glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data32);
+    #endif
     }
 }
 
 void Texture::free()
 {
+#ifndef RENDER_NULL
     glDeleteTextures(1, (GLuint*)res);
+#endif
     delete (GLuint*)res;
     res = NULL;
 }
 
 void Texture::bind() const
 {
+#ifndef RENDER_NULL
     glBindTexture(GL_TEXTURE_2D, *(GLuint*)res);
+#endif
 }
 
 // animation ==============================================
@@ -782,15 +849,16 @@ void Animation::load(Stream* stream)
     }
     ASSERT(totalFrames <= MAX_ANIMATION_FRAMES);
 
-    for (uint32 i = 0; i < totalFrames; i++)
-    {
-        framesInfo[i] = stream->u32();
-    }
+    framesInfo = new uint32[totalFrames];
+    stream->readArray(framesInfo, totalFrames);
 }
 
 void Animation::free()
 {
-    //
+    delete[] framesInfo;
+    framesInfo = NULL;
+    clipsCount = 0;
+    totalFrames = 0;
 }
 
 int32 Animation::getFrameIndex(int32 curIndex) const
@@ -809,6 +877,11 @@ void Skeleton::load(Stream* stream, const Animation* anim)
 {
     int32 basePos = stream->getPos();
 
+    frames = NULL;
+    dataFramesCount = 0;
+    angles = NULL;
+    anglesCount = 0;
+
     uint32 offsetLinks = stream->u16();
     uint32 offsetFrames = stream->u16();
 
@@ -826,12 +899,7 @@ void Skeleton::load(Stream* stream, const Animation* anim)
 
         ASSERT(count <= MAX_RANGES);
 
-        for (uint32 i = 0; i < count; i++)
-        {
-            offsets[i].x = stream->s16();
-            offsets[i].y = stream->s16();
-            offsets[i].z = stream->s16();
-        }
+        stream->readArray(offsets, count);
 
         stream->setPos(offsetLinks);
         for (uint32 i = 0; i < count; i++)
@@ -870,29 +938,79 @@ void Skeleton::load(Stream* stream, const Animation* anim)
     dataFramesCount += 1;
 
     ASSERT(dataFramesCount > 0);
+    ASSERT(dataFramesCount <= MAX_ANIMATION_FRAMES);
     ASSERT(offsetFrames > 0);
 
+    frames = new Frame[dataFramesCount];
+
     stream->setPos(offsetFrames + basePos);
-    for (int32 i = 0; i < dataFramesCount; i++)
+    if (size == sizeof(Frame))
     {
-        Frame* f = frames + i;
-        f->pos.x = stream->s16();
-        f->pos.y = stream->s16();
-        f->pos.z = stream->s16();
-        f->offset.x = stream->s16();
-        f->offset.y = stream->s16();
-        f->offset.z = stream->s16();
-        stream->read(f->angles, size - sizeof(vec3s) * 2);
+        stream->readArray(frames, dataFramesCount);
+    }
+    else
+    {
+        memset(frames, 0, dataFramesCount * sizeof(Frame));
+
+        for (int32 i = 0; i < dataFramesCount; i++)
+        {
+            stream->read(frames + i, size); // pos, offset, angles
+        }
     }
 }
 
+void Skeleton::unpack()
+{
+    if (angles || !frames)
+        return;
+
+    // joints of the packed frame, 9 bytes per pair
+    int32 jointsCount = sizeof(frames->angles) * 2 / 9;
+    if (jointsCount > count)
+    {
+        jointsCount = count;
+    }
+
+    int16* table = new int16[dataFramesCount * jointsCount * 3];
+
+    int16* ptr = table;
+    for (int32 i = 0; i < dataFramesCount; i++, ptr += jointsCount * 3)
+    {
+        for (int32 j = 0; j < jointsCount; j++)
+        {
+            int32 x, y, z;
+            getAngles(i, j, x, y, z);
+            ptr[j] = x;
+            ptr[j + jointsCount] = y;
+            ptr[j + jointsCount * 2] = z;
+        }
+    }
+
+    angles = table;
+    anglesCount = jointsCount;
+}
+
 void Skeleton::free()
 {
-    //
+    delete[] frames;
+    frames = NULL;
+    dataFramesCount = 0;
+    delete[] angles;
+    angles = NULL;
+    anglesCount = 0;
 }
 
 void Skeleton::getAngles(int32 frameIndex, int32 jointIndex, int32& x, int32& y, int32& z) const
 {
+    if (jointIndex < anglesCount)
+    {
+        const int16* ptr = angles + frameIndex * anglesCount * 3 + jointIndex;
+        x = ptr[0];
+        y = ptr[anglesCount];
+        z = ptr[anglesCount * 2];
+        return;
+    }
+
     const Frame* f = frames + frameIndex;
     int32 idx = (jointIndex >> 1) * 9;
 
@@ -952,7 +1070,7 @@ struct Vertex
 {
     vec4s coord;
     vec4s normal;
-    uint8 u, v, page, zero;
+    uint8 u, v, page, joint;
 };
 
 struct VertexUI
@@ -962,7 +1080,46 @@ struct VertexUI
     uint32 color;
 };
 
-Index addVertex(int32 idx, const Prim* prim, const Coord* coords, const Coord* normals, const Tile* tile, Vertex* vertices, int32& vCount)
+// open addressing hash of the emitted vertices
+struct VertexHash
+{
+    int32* table; // vertex index + 1, 0 for empty slots
+    uint32 mask;
+
+    void init(int32 maxVertices)
+    {
+        uint32 size = 16;
+        while (size < uint32(maxVertices * 2))
+        {
+            size <<= 1;
+        }
+
+        mask = size - 1;
+        table = new int32[size];
+        memset(table, 0, size * sizeof(int32));
+    }
+
+    void free()
+    {
+        delete[] table;
+    }
+
+    static uint32 getHash(const Vertex* v)
+    {
+        uint32 words[sizeof(Vertex) / 4];
+        memcpy(words, v, sizeof(Vertex));
+
+        uint32 h = 0;
+        for (int32 i = 0; i < sizeof(Vertex) / 4; i++)
+        {
+            h = (h ^ words[i]) * 0x9E3779B1;
+            h ^= h >> 15;
+        }
+        return h;
+    }
+};
+
+Index addVertex(int32 idx, const Prim* prim, const Coord* coords, const Coord* normals, const Tile* tile, int32 joint, Vertex* vertices, int32& vCount, VertexHash& hash)
 {
     Vertex* v = vertices + vCount;
 
@@ -977,23 +1134,38 @@ Index addVertex(int32 idx, const Prim* prim, const Coord* coords, const Coord* n
     v->u = tile->u[idx];
     v->v = tile->v[idx];
     v->page = tile->page & 3;
-    v->zero = 0;
+    v->joint = joint;
 
     // search for an existing vertex
-    for (int32 i = 0; i < vCount; i++)
+    uint32 slot = VertexHash::getHash(v) & hash.mask;
+    while (hash.table[slot])
     {
-        if (memcmp(vertices + i, v, sizeof(Vertex)) == 0)
+        int32 index = hash.table[slot] - 1;
+        if (memcmp(vertices + index, v, sizeof(Vertex)) == 0)
         {
-            return i; // found
+            return index; // found
         }
+        slot = (slot + 1) & hash.mask;
     }
 
     // not found, return new index
+    hash.table[slot] = vCount + 1;
     return vCount++;
 }
 
 void Model::load(Stream* stream)
 {
+    PROFILE("Model::load");
+
+    loadData(stream);
+    upload();
+    freeData();
+}
+
+void Model::loadData(Stream* stream)
+{
+    PROFILE("Model::loadData");
+
     struct MeshHeader
     {
         uint32 coordOffset;
@@ -1040,6 +1212,12 @@ void Model::load(Stream* stream)
     for (int32 i = 0; i < MAX_MODEL_ANIMS; i++)
     {
         animation[i].clipsCount = 0;
+        animation[i].totalFrames = 0;
+        animation[i].framesInfo = NULL;
+        skeleton[i].frames = NULL;
+        skeleton[i].dataFramesCount = 0;
+        skeleton[i].angles = NULL;
+        skeleton[i].anglesCount = 0;
 
         if (offsetAnimation[i] == 0)
             continue;
@@ -1051,10 +1229,14 @@ void Model::load(Stream* stream)
         skeleton[i].load(stream, animation + i);
     }
 
+    data = new ModelData();
+    data->texture32 = NULL;
+    data->cooked = NULL;
+
     if (offsetTexture)
     {
         stream->setPos(offsetTexture);
-        texture.load(stream);
+        loadTextureData(stream);
     }
 
     stream->setPos(offsetMesh);
@@ -1094,6 +1276,17 @@ void Model::load(Stream* stream)
     Prim* primPtr = prims;
     Tile* tilePtr = tiles;
 
+    // raw prims and tiles data of a mesh, up to 16 bytes per primitive
+    uint32 maxPrimCount = 0;
+    for (uint32 i = 0; i < count; i++)
+    {
+        if (maxPrimCount < headers[i].primCount)
+        {
+            maxPrimCount = headers[i].primCount;
+        }
+    }
+    uint16* raw = new uint16[maxPrimCount * 8];
+
     for (uint32 i = 0; i < count; i++)
     {
         MeshHeader* h = headers + i;
@@ -1103,90 +1296,94 @@ void Model::load(Stream* stream)
 
         bool isQuad = (i & 1);
 
-        // coords
+        // coords (x, y, z, padding)
         stream->setPos(h->coordOffset);
-        for (uint32 j = 0; j < h->coordCount; j++, coordPtr++)
-        {
-            coordPtr->x = stream->s16();
-            coordPtr->y = stream->s16();
-            coordPtr->z = stream->s16();
-            stream->skip(2); // padding
-        }
-            
-        // normals
+        stream->readArray(coordPtr, h->coordCount);
+        coordPtr += h->coordCount;
+
+        // normals (x, y, z, padding)
         stream->setPos(h->normOffset);
-        for (uint32 j = 0; j < h->normCount; j++, normPtr++)
-        {
-            normPtr->x = stream->s16();
-            normPtr->y = stream->s16();
-            normPtr->z = stream->s16();
-            normPtr->pad = 0;
-            stream->skip(2); // padding
-        }
+        stream->readArray(normPtr, h->normCount);
+        normPtr += h->normCount;
+
+        // primitives (normal index, coord index) * 3 or 4
+        int32 primVerts = isQuad ? 4 : 3;
 
-        // primitives
         stream->setPos(h->primOffset);
+        stream->readArray(raw, h->primCount * primVerts * 2);
+
+        const uint16* src = raw;
         for (uint32 j = 0; j < h->primCount; j++, primPtr++)
         {
-            primPtr->nIndex[0] = stream->u16() + normOffset;
-            primPtr->cIndex[0] = stream->u16() + coordOffset;
-                
-            primPtr->nIndex[1] = stream->u16() + normOffset;
-            primPtr->cIndex[1] = stream->u16() + coordOffset;
-                
-            primPtr->nIndex[2] = stream->u16() + normOffset;
-            primPtr->cIndex[2] = stream->u16() + coordOffset;
-
-            if (isQuad)
+            for (int32 k = 0; k < primVerts; k++)
             {
-                primPtr->nIndex[3] = stream->u16() + normOffset;
-                primPtr->cIndex[3] = stream->u16() + coordOffset;
+                primPtr->nIndex[k] = *src++ + normOffset;
+                primPtr->cIndex[k] = *src++ + coordOffset;
             }
-            else
+
+            if (!isQuad)
             {
                 primPtr->nIndex[3] = 0xFFFF;
                 primPtr->cIndex[3] = 0xFFFF;
             }
         }
-            
-        // tiles
+
+        // tiles (uv0, clut, uv1, page, uv2, padding[, uv3, padding])
+        int32 tileSize = isQuad ? 16 : 12;
+
         stream->setPos(h->tileOffset);
-        for (uint32 j = 0; j < h->primCount; j++, tilePtr++) // tileCount == primCount
+        stream->read(raw, h->primCount * tileSize);
+
+        const uint8* ptr = (uint8*)raw;
+        for (uint32 j = 0; j < h->primCount; j++, tilePtr++, ptr += tileSize) // tileCount == primCount
         {
-            tilePtr->u[0] = stream->u8();
-            tilePtr->v[0] = stream->u8();
-            tilePtr->clut = stream->u16();
-            tilePtr->u[1] = stream->u8();
-            tilePtr->v[1] = stream->u8();
-            tilePtr->page = stream->u16();
-            tilePtr->u[2] = stream->u8();
-            tilePtr->v[2] = stream->u8();
-            stream->skip(2); // padding
+            tilePtr->u[0] = ptr[0];
+            tilePtr->v[0] = ptr[1];
+            tilePtr->clut = ptr[2] | (ptr[3] << 8);
+            tilePtr->u[1] = ptr[4];
+            tilePtr->v[1] = ptr[5];
+            tilePtr->page = ptr[6] | (ptr[7] << 8);
+            tilePtr->u[2] = ptr[8];
+            tilePtr->v[2] = ptr[9];
             if (isQuad)
             {
-                tilePtr->u[3] = stream->u8();
-                tilePtr->v[3] = stream->u8();
-                stream->skip(2); // padding
+                tilePtr->u[3] = ptr[12];
+                tilePtr->v[3] = ptr[13];
             }
         }
     }
 
+    delete[] raw;
+
     // build index & vertex buffers
     Index* indices = new Index[primCount * 6];
     Vertex* vertices = new Vertex[primCount * 4];
     int32 iCount = 0;
     int32 vCount = 0;
 
+    VertexHash hash;
+    hash.init(primCount * 4);
+
+    // every pair of triangles & quads meshes is a part of the model attached to its own joint
+    int32 joint = -1;
+    uint32 jointEnd = 0;
+
     for (uint32 i = 0; i < primCount; i++)
     {
         Prim* prim = prims + i;
         Tile* tile = tiles + i;
 
+        while (i >= jointEnd)
+        {
+            joint++;
+            jointEnd += headers[joint * 2].primCount + headers[joint * 2 + 1].primCount;
+        }
+
         Index i0, i1, i2, i3;
 
-        i0 = addVertex(0, prim, coords, normals, tile, vertices, vCount);
-        i1 = addVertex(1, prim, coords, normals, tile, vertices, vCount);
-        i2 = addVertex(2, prim, coords, normals, tile, vertices, vCount);
+        i0 = addVertex(0, prim, coords, normals, tile, joint, vertices, vCount, hash);
+        i1 = addVertex(1, prim, coords, normals, tile, joint, vertices, vCount, hash);
+        i2 = addVertex(2, prim, coords, normals, tile, joint, vertices, vCount, hash);
 
         indices[iCount++] = i0;
         indices[iCount++] = i1;
@@ -1194,37 +1391,19 @@ void Model::load(Stream* stream)
 
         if (prim->cIndex[3] != 0xFFFF) // quad
         {
-            i3 = addVertex(3, prim, coords, normals, tile, vertices, vCount);
+            i3 = addVertex(3, prim, coords, normals, tile, joint, vertices, vCount, hash);
             indices[iCount++] = i1;
             indices[iCount++] = i3;
             indices[iCount++] = i2;
         }
     }
 
+    hash.free();
 
-    MeshData* data = new MeshData();
-    res = data;
-
-    glGenVertexArrays(1, &data->VAO);
-    glGenBuffers(2, data->VBO);
-
-    glBindVertexArray(data->VAO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, data->VBO[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, data->VBO[1]);
-
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, iCount * sizeof(Index), indices, GL_STATIC_DRAW);
-    glBufferData(GL_ARRAY_BUFFER, vCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(aCoord);
-    glEnableVertexAttribArray(aNormal);
-    glEnableVertexAttribArray(aTexCoord);
-
-    Vertex* v = NULL;
-    glVertexAttribPointer(aCoord, 3, GL_SHORT, GL_FALSE, sizeof(*v), &v->coord);
-    glVertexAttribPointer(aNormal, 3, GL_SHORT, GL_FALSE, sizeof(*v), &v->normal);
-    glVertexAttribPointer(aTexCoord, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(*v), &v->u);
-
-    glBindVertexArray(0);
+    data->indices = indices;
+    data->vertices = vertices;
+    data->iCount = iCount;
+    data->vCount = vCount;
 
     // init ranges of model parts
     rangesCount = count >> 1;
@@ -1240,8 +1419,6 @@ void Model::load(Stream* stream)
         indexOffset += range->iCount;
     }
 
-    delete[] vertices;
-    delete[] indices;
     delete[] tiles;
     delete[] prims;
     delete[] normals;
@@ -1251,11 +1428,280 @@ void Model::load(Stream* stream)
     updateInfo();
 }
 
+void Model::loadTextureData(Stream* stream)
+{
+    data->texture32 = texture.loadData(stream, data->textureWidth, data->textureHeight);
+}
+
+void Model::upload()
+{
+    MeshData* mesh = new MeshData();
+    res = mesh;
+
+#ifndef RENDER_NULL
+    glGenVertexArrays(1, &mesh->VAO);
+    glGenBuffers(2, mesh->VBO);
+
+    glBindVertexArray(mesh->VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->VBO[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO[1]);
+
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data->iCount * sizeof(Index), data->indices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, data->vCount * sizeof(Vertex), data->vertices, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(aCoord);
+    glEnableVertexAttribArray(aNormal);
+    glEnableVertexAttribArray(aTexCoord);
+
+    Vertex* v = NULL;
+    glVertexAttribPointer(aCoord, 3, GL_SHORT, GL_FALSE, sizeof(*v), &v->coord);
+    glVertexAttribPointer(aNormal, 3, GL_SHORT, GL_FALSE, sizeof(*v), &v->normal);
+    glVertexAttribPointer(aTexCoord, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(*v), &v->u);
+
+    glBindVertexArray(0);
+#endif
+
+    if (data->texture32)
+    {
+        texture.init(data->texture32, data->textureWidth, data->textureHeight);
+    }
+}
+
+void Model::freeData()
+{
+    if (data->cooked)
+    {
+        delete data->cooked;
+    }
+    else
+    {
+        delete[] (Vertex*)data->vertices;
+        delete[] (Index*)data->indices;
+        delete[] data->texture32;
+    }
+    delete data;
+    data = NULL;
+}
+
+// cooked model layout, all the arrays are 4 bytes aligned:
+// CookedInfo, vertices, indices, texture, [framesInfo, frames] per animation
+
+struct CookedInfo
+{
+    uint32 layout;
+    int32 vCount;
+    int32 iCount;
+    int32 textureWidth;
+    int32 textureHeight;
+    int16 textureX;
+    int16 textureY;
+    int32 textureCount;
+    int32 clipsCount;
+    uint32 rangesCount;
+    MeshRange ranges[MAX_RANGES];
+
+    struct Anim
+    {
+        uint32 clipsCount;
+        uint32 totalFrames;
+        Animation::Clip clips[MAX_ANIMATION_CLIPS];
+        uint32 count;
+        Skeleton::Offset offsets[MAX_RANGES];
+        Skeleton::Link links[MAX_RANGES];
+        int32 dataFramesCount;
+    } anims[MAX_MODEL_ANIMS];
+};
+
+#define COOKED_ALIGN(x)     (((x) + 3) & ~3)
+#define COOKED_LAYOUT       (sizeof(CookedInfo) ^ (sizeof(Vertex) << 16) ^ (sizeof(Index) << 24) ^ (sizeof(Skeleton::Frame) << 8))
+
+uint8* Model::cook(int32 offset, int32& size)
+{
+    CookedInfo info;
+    memset(&info, 0, sizeof(info));
+
+    info.layout = COOKED_LAYOUT;
+    info.vCount = data->vCount;
+    info.iCount = data->iCount;
+    if (data->texture32)
+    {
+        info.textureWidth = data->textureWidth;
+        info.textureHeight = data->textureHeight;
+    }
+    info.textureX = texture.x;
+    info.textureY = texture.y;
+    info.textureCount = texture.count;
+    info.clipsCount = clipsCount;
+    info.rangesCount = rangesCount;
+    memcpy(info.ranges, ranges, sizeof(ranges));
+
+    int32 vSize = COOKED_ALIGN(info.vCount * sizeof(Vertex));
+    int32 iSize = COOKED_ALIGN(info.iCount * sizeof(Index));
+    int32 tSize = info.textureWidth * info.textureHeight * 4;
+
+    size = offset + COOKED_ALIGN(sizeof(info)) + vSize + iSize + tSize;
+
+    for (int32 i = 0; i < MAX_MODEL_ANIMS; i++)
+    {
+        CookedInfo::Anim& anim = info.anims[i];
+        anim.clipsCount = animation[i].clipsCount;
+        anim.totalFrames = animation[i].totalFrames;
+        memcpy(anim.clips, animation[i].clips, sizeof(anim.clips));
+        anim.count = skeleton[i].count;
+        memcpy(anim.offsets, skeleton[i].offsets, sizeof(anim.offsets));
+        memcpy(anim.links, skeleton[i].links, sizeof(anim.links));
+        anim.dataFramesCount = skeleton[i].dataFramesCount;
+
+        if (!animation[i].framesInfo)
+        {
+            anim.totalFrames = 0;
+        }
+
+        if (!skeleton[i].frames)
+        {
+            anim.dataFramesCount = 0;
+        }
+
+        size += anim.totalFrames * sizeof(uint32) + anim.dataFramesCount * sizeof(Skeleton::Frame);
+    }
+
+    uint8* blob = new uint8[size];
+    memset(blob, 0, offset);
+
+    uint8* ptr = blob + offset;
+    memcpy(ptr, &info, sizeof(info));
+    ptr += COOKED_ALIGN(sizeof(info));
+    memcpy(ptr, data->vertices, info.vCount * sizeof(Vertex));
+    ptr += vSize;
+    memset(ptr, 0, iSize);
+    memcpy(ptr, data->indices, info.iCount * sizeof(Index));
+    ptr += iSize;
+    memcpy(ptr, data->texture32, tSize);
+    ptr += tSize;
+
+    for (int32 i = 0; i < MAX_MODEL_ANIMS; i++)
+    {
+        const CookedInfo::Anim& anim = info.anims[i];
+        memcpy(ptr, animation[i].framesInfo, anim.totalFrames * sizeof(uint32));
+        ptr += anim.totalFrames * sizeof(uint32);
+        memcpy(ptr, skeleton[i].frames, anim.dataFramesCount * sizeof(Skeleton::Frame));
+        ptr += anim.dataFramesCount * sizeof(Skeleton::Frame);
+    }
+
+    ASSERT(ptr == blob + size);
+
+    return blob;
+}
+
+bool Model::loadCooked(MmapStream* stream, int32 offset)
+{
+    PROFILE("Model::loadCooked");
+
+    if (stream->getSize() < offset + int32(sizeof(CookedInfo)))
+        return false;
+
+    CookedInfo info;
+    stream->setPos(offset);
+    stream->read(&info, sizeof(info));
+
+    if (info.layout != COOKED_LAYOUT || info.rangesCount > MAX_RANGES)
+        return false;
+
+    int32 vSize = COOKED_ALIGN(info.vCount * sizeof(Vertex));
+    int32 iSize = COOKED_ALIGN(info.iCount * sizeof(Index));
+    int32 tSize = info.textureWidth * info.textureHeight * 4;
+
+    int32 size = offset + COOKED_ALIGN(sizeof(info)) + vSize + iSize + tSize;
+    for (int32 i = 0; i < MAX_MODEL_ANIMS; i++)
+    {
+        size += info.anims[i].totalFrames * sizeof(uint32) + info.anims[i].dataFramesCount * sizeof(Skeleton::Frame);
+    }
+
+    if (size != stream->getSize())
+        return false;
+
+    int32 pos = offset + COOKED_ALIGN(sizeof(info));
+
+    data = new ModelData();
+    data->cooked = stream;
+    data->vCount = info.vCount;
+    data->iCount = info.iCount;
+    data->vertices = (void*)stream->span(pos, vSize);
+    pos += vSize;
+    data->indices = (void*)stream->span(pos, iSize);
+    pos += iSize;
+    data->texture32 = tSize ? (uint8*)stream->span(pos, tSize) : NULL;
+    data->textureWidth = info.textureWidth;
+    data->textureHeight = info.textureHeight;
+    pos += tSize;
+
+    texture.x = info.textureX;
+    texture.y = info.textureY;
+    texture.count = info.textureCount;
+
+    clipsCount = info.clipsCount;
+    rangesCount = info.rangesCount;
+    memcpy(ranges, info.ranges, sizeof(ranges));
+
+    for (int32 i = 0; i < MAX_MODEL_ANIMS; i++)
+    {
+        const CookedInfo::Anim& anim = info.anims[i];
+
+        Animation& a = animation[i];
+        a.clipsCount = anim.clipsCount;
+        a.totalFrames = anim.totalFrames;
+        memcpy(a.clips, anim.clips, sizeof(a.clips));
+        a.framesInfo = NULL;
+        if (anim.totalFrames)
+        {
+            a.framesInfo = new uint32[anim.totalFrames];
+            stream->setPos(pos);
+            stream->readArray(a.framesInfo, anim.totalFrames);
+            pos += anim.totalFrames * sizeof(uint32);
+        }
+
+        Skeleton& s = skeleton[i];
+        s.count = anim.count;
+        memcpy(s.offsets, anim.offsets, sizeof(s.offsets));
+        memcpy(s.links, anim.links, sizeof(s.links));
+        s.dataFramesCount = anim.dataFramesCount;
+        s.frames = NULL;
+        s.angles = NULL;
+        s.anglesCount = 0;
+        if (anim.dataFramesCount)
+        {
+            s.frames = new Skeleton::Frame[anim.dataFramesCount];
+            stream->setPos(pos);
+            stream->read(s.frames, anim.dataFramesCount * sizeof(Skeleton::Frame));
+            pos += anim.dataFramesCount * sizeof(Skeleton::Frame);
+        }
+    }
+
+    return true;
+}
+
 void Model::free()
 {
-    texture.free();
-    glDeleteVertexArrays(1, &((MeshData*)res)->VAO);
-    glDeleteBuffers(2, ((MeshData*)res)->VBO);
+    if (texture.res)
+    {
+        texture.free();
+    }
+
+    if (res)
+    {
+    #ifndef RENDER_NULL
+        glDeleteVertexArrays(1, &((MeshData*)res)->VAO);
+        glDeleteBuffers(2, ((MeshData*)res)->VBO);
+    #endif
+        delete (MeshData*)res;
+        res = NULL;
+    }
+
+    for (int32 i = 0; i < MAX_MODEL_ANIMS; i++)
+    {
+        animation[i].free();
+        skeleton[i].free();
+    }
 }
 
 void Model::updateInfo()
@@ -1267,6 +1713,14 @@ void Model::updateInfo()
     }
 }
 
+void Model::unpackAngles()
+{
+    for (int32 i = 0; i < MAX_MODEL_ANIMS; i++)
+    {
+        skeleton[i].unpack();
+    }
+}
+
 ClipInfo Model::getClipInfo(int32 clipIndex)
 {
     ClipInfo info;
@@ -1291,67 +1745,306 @@ ClipInfo Model::getClipInfo(int32 clipIndex)
     return info;
 }
 
-void Model::render(const vec3i& pos, int32 angle, uint16 frameIndex, const Texture* texture, const Skeleton* skeleton, const Skeleton* animSkeleton)
+#ifdef RENDER_NULL
+// null backend of the headless build, the resources are created without the GPU and nothing is drawn
+void Model::render(const RenderState& prev, const RenderState& cur, int32 factor, const Texture* texture, const Skeleton* skeleton) {}
+void renderModels() {}
+
+void renderInit() {}
+void renderFree() {}
+void renderResize(int32 width, int32 height)
 {
-    Texture* pTexture = (Texture*)texture;
-    Shader* pShader = &shaderModel;
+    gWidth = width;
+    gHeight = height;
+}
+void renderSwap() {}
+void renderClear() {}
+void renderSetCamera(const vec3i& pos, const vec3i& target, int32 persp) {}
+void renderSetAmbient(uint8 r, uint8 g, uint8 b) {}
+void renderSetLight(int32 index, const vec3s& pos, uint8 r, uint8 g, uint8 b, uint16 intensity) {}
+void renderBackground(const Texture* texture, const Texture* masks, const MaskChunk* chunks, uint32 chunksCount) {}
+void renderOverlay(const char* text) {}
+
+#ifdef _DEBUG
+void renderDebugBegin(bool planar) {}
+void renderDebugEnd() {}
+void renderDebugLines(const Index* indices, int32 iCount, const vec3s* vertices, int32 vCount, uint32 color) {}
+#endif
+
+#else
+// instances queued by Model::render and drawn by renderModels
+#define MAX_MODEL_INSTANCES 48
+#define MAX_QUEUE_JOINTS    (MAX_MODEL_INSTANCES * MAX_RANGES)
+#define MAX_BATCH_JOINTS    256 // 16 KB, the minimal size of the uniform block
+
+struct ModelInstance
+{
+    const Model* model;
+    const Texture* texture;
+    int32 joints;
+};
+
+ModelInstance gInstances[MAX_MODEL_INSTANCES];
+int32 gInstancesCount;
+mat4 gInstanceJoints[MAX_QUEUE_JOINTS];
+int32 gInstanceJointsCount;
+
+GLuint gJointsUBO;
+int32 gJointsAlign;     // uniform buffer offset alignment in matrices
+int32 gJointsSize;      // uniform buffer size in matrices
+mat4* gJointsBuffer;    // joints of the batches, each batch starts at the aligned offset
+
+void initModels()
+{
+    GLint align;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    gJointsAlign = (align + sizeof(mat4) - 1) / sizeof(mat4);
+    if (gJointsAlign < 1)
+    {
+        gJointsAlign = 1;
+    }
+
+    // every batch adds up to the alignment, the last batch binds the whole block
+    gJointsSize = MAX_QUEUE_JOINTS + MAX_MODEL_INSTANCES * gJointsAlign + MAX_BATCH_JOINTS;
+    gJointsBuffer = new mat4[gJointsSize];
+
+    glGenBuffers(1, &gJointsUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, gJointsUBO);
+    glBufferData(GL_UNIFORM_BUFFER, gJointsSize * sizeof(mat4), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    gInstancesCount = 0;
+    gInstanceJointsCount = 0;
+}
+
+void freeModels()
+{
+    glDeleteBuffers(1, &gJointsUBO);
+    delete[] gJointsBuffer;
+}
+
+void Model::render(const RenderState& prev, const RenderState& cur, int32 factor, const Texture* texture, const Skeleton* skeleton)
+{
+    PROFILE("Model::render");
+
+    if (gInstancesCount == MAX_MODEL_INSTANCES)
+    {
+        renderModels();
+    }
+
+    ModelInstance* instance = gInstances + gInstancesCount++;
+    instance->model = this;
+    instance->texture = texture;
+    instance->joints = gInstanceJointsCount;
+
+    float t = factor * (1.0f / (1 << FIXED_SHIFT));
+
+    // no blending between the joint angles of different animations, the position & the root offset are still interpolated
+    int32 poseFactor = (prev.animSkeleton != cur.animSkeleton) ? (1 << FIXED_SHIFT) : factor;
+
+    vec3s prevFramePos = prev.animSkeleton->frames[prev.frameIndex].pos;
+    vec3s curFramePos = cur.animSkeleton->frames[cur.frameIndex].pos;
+
+    float angle = prev.angle + int16(cur.angle - prev.angle) * t;
 
     gModelMatrix.identity();
-    gModelMatrix.translate(pos.x, pos.y, pos.z);
+    gModelMatrix.translate(prev.pos.x + (cur.pos.x - prev.pos.x) * t,
+                           prev.pos.y + (cur.pos.y - prev.pos.y) * t,
+                           prev.pos.z + (cur.pos.z - prev.pos.z) * t);
     gModelMatrix.rotateY(-angle * PI / 32768.0f);
+    gModelMatrix.translate(prevFramePos.x + (curFramePos.x - prevFramePos.x) * t,
+                           prevFramePos.y + (curFramePos.y - prevFramePos.y) * t - FLOOR_HEIGHT,
+                           prevFramePos.z + (curFramePos.z - prevFramePos.z) * t);
+
+    Pose pose;
+    poseInit(&pose, skeleton);
+    poseEvaluateLerp(&pose, skeleton, prev.animSkeleton, prev.frameIndex, cur.animSkeleton, cur.frameIndex, poseFactor);
 
-    vec3s framePos = animSkeleton->frames[frameIndex].pos;
-    gModelMatrix.translate(framePos.x, framePos.y - FLOOR_HEIGHT, framePos.z);
+    // the meshes not linked to the skeleton collapse to a point
+    mat4* joints = gInstanceJoints + gInstanceJointsCount;
+    memset(joints, 0, rangesCount * sizeof(mat4));
 
-    glBindTexture(GL_TEXTURE_2D, *((GLuint*)pTexture->res));
-    vec4 texParam = { 1.0f / pTexture->width, 1.0f / pTexture->height, 1.0f / pTexture->count, 0.0f };
+    for (int32 i = 0; i < pose.count; i++)
+    {
+        int32 index = pose.order[i];
+        ASSERT(index < rangesCount);
+
+        const PoseMatrix& p = pose.joints[index];
+
+        mat4 m;
+        m.e00 = p.e00 * (1.0f / (1 << FIXED_SHIFT));
+        m.e01 = p.e01 * (1.0f / (1 << FIXED_SHIFT));
+        m.e02 = p.e02 * (1.0f / (1 << FIXED_SHIFT));
+        m.e03 = (float)p.e03;
+        m.e10 = p.e10 * (1.0f / (1 << FIXED_SHIFT));
+        m.e11 = p.e11 * (1.0f / (1 << FIXED_SHIFT));
+        m.e12 = p.e12 * (1.0f / (1 << FIXED_SHIFT));
+        m.e13 = (float)p.e13;
+        m.e20 = p.e20 * (1.0f / (1 << FIXED_SHIFT));
+        m.e21 = p.e21 * (1.0f / (1 << FIXED_SHIFT));
+        m.e22 = p.e22 * (1.0f / (1 << FIXED_SHIFT));
+        m.e23 = (float)p.e23;
+        m.e30 = m.e31 = m.e32 = 0.0f;
+        m.e33 = 1.0f;
+
+        joints[index] = gModelMatrix * m;
+    }
+
+    gInstanceJointsCount += rangesCount;
+}
+
+void renderModels()
+{
+    if (!gInstancesCount)
+        return;
+
+    PROFILE("renderModels");
+
+    // group the instances of the same model & texture
+    for (int32 i = 1; i < gInstancesCount; i++)
+    {
+        ModelInstance instance = gInstances[i];
+
+        int32 j = i - 1;
+        while (j >= 0 && (gInstances[j].model > instance.model || (gInstances[j].model == instance.model && gInstances[j].texture > instance.texture)))
+        {
+            gInstances[j + 1] = gInstances[j];
+            j--;
+        }
+        gInstances[j + 1] = instance;
+    }
+
+    struct Batch
+    {
+        int32 first;
+        int32 count;
+        int32 offset;
+    };
+
+    Batch batches[MAX_MODEL_INSTANCES];
+    int32 batchesCount = 0;
+    int32 jointsCount = 0;
+
+    for (int32 i = 0; i < gInstancesCount; i++)
+    {
+        const ModelInstance* instance = gInstances + i;
+        int32 count = instance->model->rangesCount;
+
+        Batch* batch = batches + batchesCount - 1;
+
+        if (!batchesCount ||
+            gInstances[batch->first].model != instance->model ||
+            gInstances[batch->first].texture != instance->texture ||
+            (batch->count + 1) * count > MAX_BATCH_JOINTS)
+        {
+            batch = batches + batchesCount++;
+            batch->first = i;
+            batch->count = 0;
+            batch->offset = (jointsCount + gJointsAlign - 1) / gJointsAlign * gJointsAlign;
+            jointsCount = batch->offset;
+        }
 
+        memcpy(gJointsBuffer + jointsCount, gInstanceJoints + instance->joints, count * sizeof(mat4));
+        jointsCount += count;
+        batch->count++;
+    }
+
+    ASSERT(jointsCount + MAX_BATCH_JOINTS <= gJointsSize);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, gJointsUBO);
+    glBufferData(GL_UNIFORM_BUFFER, gJointsSize * sizeof(mat4), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, jointsCount * sizeof(mat4), gJointsBuffer);
+    gCounters.add(CNT_UNIFORMS);
+
+    Shader* pShader = &shaderModel;
     pShader->bind();
     pShader->setMatrix(uViewProjMatrix, &gViewProjMatrix);
-    pShader->setVector(uTexParam, &texParam, 1);
     pShader->setVector(uAmbient, &gAmbient, 1);
     pShader->setVector(uLightColor, gLightColor, MAX_LIGHTS);
     pShader->setVector(uLightPos, gLightPos, MAX_LIGHTS);
 
-    renderMesh(0, frameIndex, skeleton, animSkeleton);
-}
+    for (int32 i = 0; i < batchesCount; i++)
+    {
+        const Batch* batch = batches + i;
+        const Model* model = gInstances[batch->first].model;
+        const Texture* texture = gInstances[batch->first].texture;
 
-void Model::renderMesh(uint32 meshIndex, uint32 frameIndex, const Skeleton* skeleton, const Skeleton* animSkeleton)
-{
-    const Skeleton::Offset& offset = skeleton->offsets[meshIndex];
-    gModelMatrix.translate(offset.x, offset.y, offset.z);
+        glBindTexture(GL_TEXTURE_2D, *((GLuint*)texture->res));
+        // w is the joints count of the instance
+        vec4 texParam = { 1.0f / texture->width, 1.0f / texture->height, 1.0f / texture->count, (float)model->rangesCount };
+        pShader->setVector(uTexParam, &texParam, 1);
 
-    int32 rx, ry, rz;
-    animSkeleton->getAngles(frameIndex, meshIndex, rx, ry, rz);
+        glBindBufferRange(GL_UNIFORM_BUFFER, 0, gJointsUBO, batch->offset * sizeof(mat4), MAX_BATCH_JOINTS * sizeof(mat4));
 
-    gModelMatrix.rotateX(rx * (DEG2RAD * 360.0f / 4096.0f));
-    gModelMatrix.rotateY(ry * (DEG2RAD * 360.0f / 4096.0f));
-    gModelMatrix.rotateZ(rz * (DEG2RAD * 360.0f / 4096.0f));
+        // the ranges are sequential, draw the whole model at once
+        const MeshRange& last = model->ranges[model->rangesCount - 1];
 
-    shaderModel.setMatrix(uModelMatrix, &gModelMatrix);
+        glBindVertexArray(((MeshData*)model->res)->VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, last.iStart + last.iCount, GL_UNSIGNED_SHORT, NULL, batch->count);
+        gCounters.add(CNT_DRAW_CALLS);
+    }
 
-    ASSERT(meshIndex < rangesCount);
-    MeshRange* range = ranges + meshIndex;
+    glBindVertexArray(0);
 
-    glBindVertexArray(((MeshData*)res)->VAO);
-    glDrawElements(GL_TRIANGLES, range->iCount, GL_UNSIGNED_SHORT, (Index*)(range->iStart * sizeof(Index)));
+    gInstancesCount = 0;
+    gInstanceJointsCount = 0;
+}
 
-    uint32 childsCount = skeleton->links[meshIndex].count;
+// overlay ==============================================
+#define FONT_CHAR_WIDTH     4 // 3x5 glyph with the spacing
+#define FONT_CHAR_HEIGHT    6
+#define FONT_FIRST_CHAR     32
+#define FONT_CHARS_COUNT    64 // space to underscore, the lower case is mapped to the upper one
+#define FONT_COLUMNS        16
+#define FONT_WIDTH          (FONT_COLUMNS * FONT_CHAR_WIDTH)
+#define FONT_HEIGHT         32 // the rows below the glyphs are solid for the overlay backdrop
+#define FONT_SOLID_Y        28
+
+#define OVERLAY_BACK_COLOR  0xA0000000 // AABBGGRR
+
+// 5 rows of 3 bits, the high bit is the left pixel of the top row
+const uint16 gFontGlyphs[FONT_CHARS_COUNT] = {
+    0x0000, 0x2482, 0x5A00, 0x5F7D, 0x3C9E, 0x52A5, 0x2AAB, 0x2400,
+    0x1491, 0x4494, 0x0AA8, 0x05D0, 0x0014, 0x01C0, 0x0002, 0x12A4,
+    0x7B6F, 0x2C97, 0x73E7, 0x72CF, 0x5BC9, 0x79CF, 0x79EF, 0x7292,
+    0x7BEF, 0x7BCF, 0x0410, 0x0414, 0x1511, 0x0E38, 0x4454, 0x72C2,
+    0x7BE7, 0x2BED, 0x6BAE, 0x3923, 0x6B6E, 0x79A7, 0x79A4, 0x396B,
+    0x5BED, 0x7497, 0x126A, 0x5BAD, 0x4927, 0x5FED, 0x6B6D, 0x2B6A,
+    0x6BA4, 0x2B73, 0x6BAD, 0x388E, 0x7492, 0x5B6F, 0x5B6A, 0x5BFD,
+    0x5AAD, 0x5A92, 0x72A7, 0x3493, 0x4889, 0x6496, 0x2A00, 0x0007
+};
 
-    for (uint32 i = 0; i < childsCount; i++)
-    {
-        if (childsCount > 1)
-        {
-            matrixPush();
-        }
+Texture gFontTexture;
 
-        renderMesh(skeleton->links[meshIndex].childs[i], frameIndex, skeleton, animSkeleton);
+void initFont()
+{
+    uint32* data = new uint32[FONT_WIDTH * FONT_HEIGHT];
+    memset(data, 0, FONT_WIDTH * FONT_HEIGHT * sizeof(uint32));
 
-        if (childsCount > 1)
+    for (int32 i = 0; i < FONT_CHARS_COUNT; i++)
+    {
+        uint32* cell = data + (i / FONT_COLUMNS) * FONT_CHAR_HEIGHT * FONT_WIDTH + (i % FONT_COLUMNS) * FONT_CHAR_WIDTH;
+
+        for (int32 y = 0; y < 5; y++)
         {
-            matrixPop();
+            for (int32 x = 0; x < 3; x++)
+            {
+                if (gFontGlyphs[i] & (1 << (14 - y * 3 - x)))
+                {
+                    cell[y * FONT_WIDTH + x] = 0xFFFFFFFF;
+                }
+            }
         }
     }
+
+    for (int32 i = FONT_CHARS_COUNT / FONT_COLUMNS * FONT_CHAR_HEIGHT * FONT_WIDTH; i < FONT_WIDTH * FONT_HEIGHT; i++)
+    {
+        data[i] = 0xFFFFFFFF;
+    }
+
+    gFontTexture.init((uint8*)data, FONT_WIDTH, FONT_HEIGHT);
+
+    delete[] data;
 }
 
 // render ==============================================
@@ -1486,9 +2179,17 @@ void renderInit()
     GetProcOGL(glDeleteVertexArrays);
     GetProcOGL(glBindVertexArray);
 
+    GetProcOGL(glDrawElementsInstanced);
+    GetProcOGL(glGetUniformBlockIndex);
+    GetProcOGL(glUniformBlockBinding);
+    GetProcOGL(glBindBufferRange);
+
     compileShader(&shaderModel, sh_model);
     compileShader(&shaderBackground, sh_background);
     compileShader(&shaderBackgroundMask, sh_background_mask);
+    compileShader(&shaderOverlay, sh_overlay);
+
+    initModels();
 
 #ifdef _DEBUG
     compileShader(&shaderDebug, sh_debug);
@@ -1551,10 +2252,16 @@ void renderInit()
     glVertexAttribPointer(aColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(*v), &v->color);
 
     glBindVertexArray(0);
+
+    initFont();
 }
 
 void renderFree()
 {
+    freeModels();
+
+    gFontTexture.free();
+
 #ifdef __WIN32__
     wglMakeCurrent(0, 0);
     wglDeleteContext(hRC);
@@ -1694,6 +2401,8 @@ int32 uiAddQuad(VertexUI* vertices, const vec2s& src, const vec2s& dst, const ve
 
 void renderBackground(const Texture* texture, const Texture* masks, const MaskChunk* chunks, uint32 chunksCount)
 {
+    PROFILE("renderBackground");
+
     ASSERT(chunksCount + 1 <= MAX_UI_PRIMS);
 
     static const vec2s bgPos = { 0, 0 };
@@ -1732,6 +2441,7 @@ void renderBackground(const Texture* texture, const Texture* masks, const MaskCh
 
         glDisable(GL_DEPTH_TEST);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, NULL);
+        gCounters.add(CNT_DRAW_CALLS);
         glEnable(GL_DEPTH_TEST);
     }
 
@@ -1746,7 +2456,129 @@ void renderBackground(const Texture* texture, const Texture* masks, const MaskCh
         pShader->setVector(uTexParam, &texParam, 1);
 
         glDrawElements(GL_TRIANGLES, (vCount/ 4 - 1) * 6, GL_UNSIGNED_SHORT, (GLvoid*)(sizeof(Index) * 6)); // offset from background quad
+        gCounters.add(CNT_DRAW_CALLS);
+    }
+}
+
+void flushOverlay(const VertexUI* vertices, int32 vCount)
+{
+    if (!vCount)
+        return;
+
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(VertexUI) * vCount, vertices);
+    glDrawElements(GL_TRIANGLES, vCount / 4 * 6, GL_UNSIGNED_SHORT, NULL);
+    gCounters.add(CNT_DRAW_CALLS);
+}
+
+void renderOverlay(const char* text)
+{
+    int32 cols = 0;
+    int32 rows = 0;
+    int32 length = 0;
+
+    for (const char* c = text; *c; c++)
+    {
+        if (*c == '\n')
+        {
+            rows++;
+            length = 0;
+        }
+        else if (++length > cols)
+        {
+            cols = length;
+        }
+    }
+
+    if (length)
+    {
+        rows++;
     }
+
+    if (!rows)
+        return;
+
+    mat4 mProj;
+    int32 h = int(320 * (float)gHeight / (float)gWidth * 0.5f);
+    mProj.ortho(0, 320, 120 + h, 120 - h, 0, 1);
+
+    Shader* pShader = &shaderOverlay;
+    pShader->bind();
+    gFontTexture.bind();
+    vec4 texParam = { 1.0f / FONT_WIDTH, 1.0f / FONT_HEIGHT, 0.0f, 0.0f };
+    pShader->setMatrix(uViewProjMatrix, &mProj);
+    pShader->setVector(uTexParam, &texParam, 1);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_DEPTH_TEST);
+
+    glBindVertexArray(uiVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, uiVBO[1]);
+
+    VertexUI vertices[MAX_UI_PRIMS * 4];
+    VertexUI* vptr = vertices;
+
+    vec2s pos = { 2, int16(120 - h + 2) };
+
+    { // backdrop, all the vertices sample the solid rows of the font
+        vec2s src = { 0, FONT_SOLID_Y };
+        vec2s dst = { int16(pos.x - 1), int16(pos.y - 1) };
+        vec2s size = { int16(cols * FONT_CHAR_WIDTH + 1), int16(rows * FONT_CHAR_HEIGHT + 1) };
+        uiAddQuad(vptr, src, dst, size, 0);
+
+        for (int32 i = 0; i < 4; i++, vptr++)
+        {
+            vptr->uv = src;
+            vptr->color = OVERLAY_BACK_COLOR;
+        }
+    }
+
+    static const vec2s charSize = { FONT_CHAR_WIDTH, FONT_CHAR_HEIGHT };
+    vec2s dst = pos;
+
+    for (const char* c = text; *c; c++)
+    {
+        if (*c == '\n')
+        {
+            dst.x = pos.x;
+            dst.y += FONT_CHAR_HEIGHT;
+            continue;
+        }
+
+        int32 index = *c;
+
+        if (index >= 'a' && index <= 'z')
+        {
+            index += 'A' - 'a';
+        }
+
+        index -= FONT_FIRST_CHAR;
+
+        if (index < 0 || index >= FONT_CHARS_COUNT)
+        {
+            index = '?' - FONT_FIRST_CHAR;
+        }
+
+        if (index)
+        {
+            if (vptr == vertices + MAX_UI_PRIMS * 4)
+            {
+                flushOverlay(vertices, MAX_UI_PRIMS * 4);
+                vptr = vertices;
+            }
+
+            vec2s src = { int16(index % FONT_COLUMNS * FONT_CHAR_WIDTH), int16(index / FONT_COLUMNS * FONT_CHAR_HEIGHT) };
+            vptr += uiAddQuad(vptr, src, dst, charSize, 0);
+        }
+
+        dst.x += FONT_CHAR_WIDTH;
+    }
+
+    flushOverlay(vertices, vptr - vertices);
+
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
 }
 
 #ifdef _DEBUG
@@ -1760,6 +2592,7 @@ void renderDebugFlush()
     glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(Index) * gDebugIndicesCount, gDebugIndices);
     glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(DebugVertex) * gDebugVerticesCount, gDebugVertices);
     glDrawElements(gDebugTopology, gDebugIndicesCount, GL_UNSIGNED_SHORT, NULL);
+    gCounters.add(CNT_DRAW_CALLS);
 
     gDebugIndicesCount = 0;
     gDebugVerticesCount = 0;
@@ -1826,3 +2659,5 @@ void renderDebugLines(const Index* indices, int32 iCount, const vec3s* vertices,
     gDebugTopology = GL_LINES;
 }
 #endif
+
+#endif
@@ -83,8 +83,8 @@ struct Player
     vec3i pos;
     vec3i dir;
 
-    Model model;
-    Model weapon;
+    Model* model; // shared by modelCache
+    Model* weapon;
 
     int32 animFrame;
     int32 frameIndex;
@@ -97,6 +97,8 @@ struct Player
     Collision* collision;
     const Collision* stairs;
 
+    RenderState prevState;
+
     void init(ModelID id)
     {
         pos.x = pos.y = pos.z = 0;
@@ -120,19 +122,35 @@ struct Player
         addSuffix(path + strlen(path), modelId);
         strcat(path, ".PLD");
 
-        FileStream stream(path);
-        model.load(&stream);
+        model = loadModel(path);
 
+        weapon = NULL;
         setWeapon(WEAPON_NONE);
+
+        prevState = getState();
     }
 
-    void setWeapon(WeaponID id)
+    static Model* loadModel(const char* path)
     {
-        if (weaponId != WEAPON_MAX)
+        Model* model = modelCache.acquire(path);
+
+        if (!model)
         {
-            weapon.free();
+            model = new Model();
+            loadModelCooked(model, path, NULL);
+            applyAnglesMode(model, gPlayerAnglesMode);
+            model->upload();
+            model->freeData();
+            modelCache.add(path, model);
         }
 
+        return model;
+    }
+
+    void setWeapon(WeaponID id)
+    {
+        modelCache.release(weapon);
+
         weaponId = id;
 
         char path[32];
@@ -142,14 +160,15 @@ struct Player
         addSuffix(path + strlen(path), weaponId);
         strcat(path, ".PLW");
 
-        FileStream stream(path);
-        weapon.load(&stream);
+        weapon = loadModel(path);
     }
 
     void free()
     {
-        model.free();
-        weapon.free();
+        modelCache.release(model);
+        modelCache.release(weapon);
+        model = NULL;
+        weapon = NULL;
     }
 
     void reset(const vec3s& newPos, int32 newAngle, int32 newFloor)
@@ -161,6 +180,8 @@ struct Player
         floor = newFloor;
         setState(STATE_IDLE);
         setAnim(ANIM_IDLE);
+
+        prevState = getState();
     }
 
     void setAnim(AnimationID id)
@@ -179,6 +200,8 @@ struct Player
 
     void update()
     {
+        prevState = getState();
+
         if (health == 0)
         {
             setState(STATE_DEATH);
@@ -246,17 +269,17 @@ struct Player
 
         if (animId >= ANIM_WALK)
         {
-            clip = weapon.animation[0].clips + animId - ANIM_WALK;
+            clip = weapon->animation[0].clips + animId - ANIM_WALK;
 
-            frameIndex = weapon.animation[0].getFrameIndex(clip->start + (animFrame % clip->count));
-            frame = weapon.skeleton[0].frames + frameIndex;
+            frameIndex = weapon->animation[0].getFrameIndex(clip->start + (animFrame % clip->count));
+            frame = weapon->skeleton[0].frames + frameIndex;
         }
         else
         {
-            clip = model.animation[0].clips + animId;
+            clip = model->animation[0].clips + animId;
 
-            frameIndex = model.animation[0].getFrameIndex(clip->start + (animFrame % clip->count));
-            frame = model.skeleton[0].frames + frameIndex;
+            frameIndex = model->animation[0].getFrameIndex(clip->start + (animFrame % clip->count));
+            frame = model->skeleton[0].frames + frameIndex;
         }
 
         if (animFrame == 0)
@@ -504,16 +527,19 @@ struct Player
         }
     }
 
+    RenderState getState() const
+    {
+        RenderState state;
+        state.pos = pos;
+        state.angle = angle;
+        state.frameIndex = frameIndex;
+        state.animSkeleton = (animId < ANIM_WALK) ? &model->skeleton[0] : &weapon->skeleton[0];
+        return state;
+    }
+
     void render()
     {
-        if (animId < ANIM_WALK)
-        {
-            model.render(pos, angle, frameIndex, &model.texture, &model.skeleton[0], &model.skeleton[0]);
-        }
-        else
-        {
-            model.render(pos, angle, frameIndex, &model.texture, &model.skeleton[0], &weapon.skeleton[0]);
-        }
+        model->render(prevState, getState(), gTickFactor, &model->texture, &model->skeleton[0]);
     }
 };
 
@@ -0,0 +1,157 @@
+#ifndef H_POSE
+#define H_POSE
+
+#include "types.h"
+#include "tables.h"
+#include "render.h"
+
+// skeleton pose evaluation in fixed point, doesn't depend on the renderer
+
+#define POSE_ROUND  (1 << (FIXED_SHIFT - 1)) // rounding of the products to reduce the error accumulated by the hierarchy
+
+// 3x4 matrix, rotation with FIXED_SHIFT fraction bits, translation in model units
+struct PoseMatrix
+{
+    int32 e00, e01, e02, e03;
+    int32 e10, e11, e12, e13;
+    int32 e20, e21, e22, e23;
+};
+
+struct Pose
+{
+    PoseMatrix joints[MAX_RANGES];  // model space matrices indexed by joint
+    uint8 order[MAX_RANGES];        // joints reachable from the root, parents before childs
+    int8 parents[MAX_RANGES];
+    int32 count;
+};
+
+// flattens the skeleton hierarchy
+static inline void poseInit(Pose* pose, const Skeleton* skeleton)
+{
+    uint8 stack[MAX_RANGES];
+    int32 stackSize = 0;
+
+    pose->count = 0;
+    pose->parents[0] = -1;
+    stack[stackSize++] = 0;
+
+    while (stackSize && pose->count < MAX_RANGES)
+    {
+        int32 index = stack[--stackSize];
+        pose->order[pose->count++] = index;
+
+        const Skeleton::Link& link = skeleton->links[index];
+
+        // reversed to keep the original traversal order
+        for (int32 i = link.count - 1; i >= 0; i--)
+        {
+            int32 child = link.childs[i];
+
+            ASSERT(child < MAX_RANGES);
+            if (stackSize == MAX_RANGES)
+                break;
+
+            pose->parents[child] = index;
+            stack[stackSize++] = child;
+        }
+    }
+}
+
+// rotation X * Y * Z of the 12-bit joint angles
+static inline void poseRotation(PoseMatrix& m, int32 rx, int32 ry, int32 rz)
+{
+    int32 sx, cx, sy, cy, sz, cz;
+    x_sincos(rx << 4, sx, cx);
+    x_sincos(ry << 4, sy, cy);
+    x_sincos(rz << 4, sz, cz);
+
+    int32 sxsy = (sx * sy + POSE_ROUND) >> FIXED_SHIFT;
+    int32 cxsy = (cx * sy + POSE_ROUND) >> FIXED_SHIFT;
+
+    m.e00 = (cy * cz + POSE_ROUND) >> FIXED_SHIFT;
+    m.e01 = (POSE_ROUND - cy * sz) >> FIXED_SHIFT;
+    m.e02 = sy;
+    m.e10 = (sxsy * cz + cx * sz + POSE_ROUND) >> FIXED_SHIFT;
+    m.e11 = (cx * cz - sxsy * sz + POSE_ROUND) >> FIXED_SHIFT;
+    m.e12 = (POSE_ROUND - sx * cy) >> FIXED_SHIFT;
+    m.e20 = (sx * sz - cxsy * cz + POSE_ROUND) >> FIXED_SHIFT;
+    m.e21 = (cxsy * sz + sx * cz + POSE_ROUND) >> FIXED_SHIFT;
+    m.e22 = (cx * cy + POSE_ROUND) >> FIXED_SHIFT;
+}
+
+// parent * local
+static inline void poseMultiply(PoseMatrix& r, const PoseMatrix& p, const PoseMatrix& l)
+{
+    r.e00 = (p.e00 * l.e00 + p.e01 * l.e10 + p.e02 * l.e20 + POSE_ROUND) >> FIXED_SHIFT;
+    r.e01 = (p.e00 * l.e01 + p.e01 * l.e11 + p.e02 * l.e21 + POSE_ROUND) >> FIXED_SHIFT;
+    r.e02 = (p.e00 * l.e02 + p.e01 * l.e12 + p.e02 * l.e22 + POSE_ROUND) >> FIXED_SHIFT;
+    r.e03 = ((p.e00 * l.e03 + p.e01 * l.e13 + p.e02 * l.e23 + POSE_ROUND) >> FIXED_SHIFT) + p.e03;
+    r.e10 = (p.e10 * l.e00 + p.e11 * l.e10 + p.e12 * l.e20 + POSE_ROUND) >> FIXED_SHIFT;
+    r.e11 = (p.e10 * l.e01 + p.e11 * l.e11 + p.e12 * l.e21 + POSE_ROUND) >> FIXED_SHIFT;
+    r.e12 = (p.e10 * l.e02 + p.e11 * l.e12 + p.e12 * l.e22 + POSE_ROUND) >> FIXED_SHIFT;
+    r.e13 = ((p.e10 * l.e03 + p.e11 * l.e13 + p.e12 * l.e23 + POSE_ROUND) >> FIXED_SHIFT) + p.e13;
+    r.e20 = (p.e20 * l.e00 + p.e21 * l.e10 + p.e22 * l.e20 + POSE_ROUND) >> FIXED_SHIFT;
+    r.e21 = (p.e20 * l.e01 + p.e21 * l.e11 + p.e22 * l.e21 + POSE_ROUND) >> FIXED_SHIFT;
+    r.e22 = (p.e20 * l.e02 + p.e21 * l.e12 + p.e22 * l.e22 + POSE_ROUND) >> FIXED_SHIFT;
+    r.e23 = ((p.e20 * l.e03 + p.e21 * l.e13 + p.e22 * l.e23 + POSE_ROUND) >> FIXED_SHIFT) + p.e23;
+}
+
+static inline void poseSetJoint(Pose* pose, const Skeleton* skeleton, int32 index, int32 rx, int32 ry, int32 rz)
+{
+    PoseMatrix local;
+    poseRotation(local, rx, ry, rz);
+
+    const Skeleton::Offset& offset = skeleton->offsets[index];
+    local.e03 = offset.x;
+    local.e13 = offset.y;
+    local.e23 = offset.z;
+
+    int32 parent = pose->parents[index];
+
+    if (parent < 0)
+    {
+        pose->joints[index] = local;
+    }
+    else
+    {
+        poseMultiply(pose->joints[index], pose->joints[parent], local);
+    }
+}
+
+// joint matrices of the frame, the hierarchy & offsets from the skeleton, the angles from the animSkeleton
+static inline void poseEvaluate(Pose* pose, const Skeleton* skeleton, const Skeleton* animSkeleton, int32 frameIndex)
+{
+    for (int32 i = 0; i < pose->count; i++)
+    {
+        int32 index = pose->order[i];
+
+        int32 rx, ry, rz;
+        animSkeleton->getAngles(frameIndex, index, rx, ry, rz);
+
+        poseSetJoint(pose, skeleton, index, rx, ry, rz);
+    }
+}
+
+// 12-bit angle from a to b by the shortest arc
+static inline int32 poseLerpAngle(int32 a, int32 b, int32 factor)
+{
+    int32 delta = ((b - a + 2048) & 4095) - 2048;
+    return a + ((delta * factor) >> FIXED_SHIFT);
+}
+
+// same for the angles blended between two frames by the factor with FIXED_SHIFT fraction bits
+static inline void poseEvaluateLerp(Pose* pose, const Skeleton* skeleton, const Skeleton* animA, int32 frameA, const Skeleton* animB, int32 frameB, int32 factor)
+{
+    for (int32 i = 0; i < pose->count; i++)
+    {
+        int32 index = pose->order[i];
+
+        int32 ax, ay, az, bx, by, bz;
+        animA->getAngles(frameA, index, ax, ay, az);
+        animB->getAngles(frameB, index, bx, by, bz);
+
+        poseSetJoint(pose, skeleton, index, poseLerpAngle(ax, bx, factor), poseLerpAngle(ay, by, factor), poseLerpAngle(az, bz, factor));
+    }
+}
+
+#endif
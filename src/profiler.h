@@ -0,0 +1,192 @@
+#ifndef H_PROFILER
+#define H_PROFILER
+
+#include <stdio.h>
+
+#include "types.h"
+
+// scoped zones of the hot paths, compiled out unless USE_PROFILER is defined
+// every thread writes the zones to its own ring buffer, the dump saves the last PROFILE_RING_SIZE zones
+// of each thread in the Chrome trace event format (chrome://tracing or ui.perfetto.dev)
+
+#define MAX_PROFILE_THREADS     16
+#define PROFILE_RING_SIZE       16384 // zones per thread, power of two
+#define PROFILE_DEFAULT_TRACE   "trace.json"
+
+int64 osGetTimeUS();
+
+#ifdef USE_PROFILER
+
+#ifdef _WIN32
+    #include <intrin.h>
+    #define PROFILE_THREAD_LOCAL        __declspec(thread)
+    #define profileAtomicAdd(x)         (_InterlockedIncrement((volatile long*)&(x)) - 1)
+    #define profileLoadAcquire(x)       (*(volatile uint32*)&(x))
+    #define profileStoreRelease(x, v)   (*(volatile uint32*)&(x) = (v))
+    #define profileFenceAcquire()       _ReadWriteBarrier()
+#else
+    #define PROFILE_THREAD_LOCAL        __thread
+    #define profileAtomicAdd(x)         __sync_fetch_and_add(&(x), 1)
+    #define profileLoadAcquire(x)       __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+    #define profileStoreRelease(x, v)   __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+    #define profileFenceAcquire()       __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+struct ProfileEvent
+{
+    const char* name;
+    int64 start;
+    int32 duration;
+};
+
+struct ProfileRing
+{
+    ProfileEvent events[PROFILE_RING_SIZE];
+    uint32 head; // total count of the written zones, published after the zone is written
+    const char* name;
+};
+
+// zero initialized, shared by the translation units through the inline accessor
+struct Profiler
+{
+    ProfileRing* rings[MAX_PROFILE_THREADS];
+    int32 ringsCount;
+};
+
+inline Profiler& getProfiler()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+// ring buffer of the calling thread, allocated on the first zone
+inline ProfileRing* profileGetRing()
+{
+    static PROFILE_THREAD_LOCAL ProfileRing* ring;
+
+    if (!ring)
+    {
+        Profiler& profiler = getProfiler();
+
+        int32 index = profileAtomicAdd(profiler.ringsCount);
+        if (index >= MAX_PROFILE_THREADS)
+            return NULL;
+
+        ring = new ProfileRing();
+        ring->head = 0;
+        ring->name = NULL;
+
+        profiler.rings[index] = ring;
+    }
+
+    return ring;
+}
+
+inline void profileSetThreadName(const char* name)
+{
+    ProfileRing* ring = profileGetRing();
+    if (ring)
+    {
+        ring->name = name;
+    }
+}
+
+struct ProfileZone
+{
+    ProfileRing* ring;
+    const char* name;
+    int64 start;
+
+    ProfileZone(const char* name) : ring(profileGetRing()), name(name), start(osGetTimeUS()) {}
+
+    ~ProfileZone()
+    {
+        int64 end = osGetTimeUS();
+
+        if (!ring)
+            return;
+
+        uint32 head = ring->head;
+
+        ProfileEvent& e = ring->events[head & (PROFILE_RING_SIZE - 1)];
+        e.name = name;
+        e.start = start;
+        e.duration = int32(end - start);
+
+        profileStoreRelease(ring->head, head + 1);
+    }
+};
+
+// the other threads keep running, every ring is copied and the zones overwritten during the copy are dropped
+inline bool profileDump(const char* path)
+{
+    Profiler& profiler = getProfiler();
+
+    FILE* f = fopen(path, "wb");
+    if (!f)
+    {
+        printf("can't save trace %s\n", path);
+        return false;
+    }
+
+    ProfileEvent* events = new ProfileEvent[PROFILE_RING_SIZE];
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    int32 count = 0;
+    int32 ringsCount = profiler.ringsCount < MAX_PROFILE_THREADS ? profiler.ringsCount : MAX_PROFILE_THREADS;
+
+    for (int32 tid = 0; tid < ringsCount; tid++)
+    {
+        const ProfileRing* ring = profiler.rings[tid];
+        if (!ring)
+            continue;
+
+        if (ring->name)
+        {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                count++ ? ",\n" : "", tid, ring->name);
+        }
+
+        uint32 head = profileLoadAcquire(ring->head);
+        memcpy(events, ring->events, sizeof(ring->events));
+        profileFenceAcquire();
+        uint32 written = profileLoadAcquire(ring->head);
+
+        // the slot of the next zone may be written right now, the zones before it are valid
+        uint32 first = written >= PROFILE_RING_SIZE ? written - PROFILE_RING_SIZE + 1 : 0;
+
+        for (uint32 i = first; i < head; i++)
+        {
+            const ProfileEvent& e = events[i & (PROFILE_RING_SIZE - 1)];
+
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%d}",
+                count++ ? ",\n" : "", e.name, tid, (long long)e.start, e.duration);
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    delete[] events;
+
+    printf("trace saved %s zones: %d\n", path, count);
+
+    return true;
+}
+
+#define PROFILE_CONCAT_(a, b)       a##b
+#define PROFILE_CONCAT(a, b)        PROFILE_CONCAT_(a, b)
+#define PROFILE(name)               ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name)        profileSetThreadName(name)
+#define PROFILE_DUMP(path)          profileDump(path)
+
+#else
+
+#define PROFILE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_DUMP(path)          printf("trace %s isn't saved, build with -DUSE_PROFILER\n", path)
+
+#endif
+
+#endif
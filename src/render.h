@@ -16,6 +16,7 @@ struct Texture
     int32 count;
 
     void load(Stream* stream);
+    uint8* loadData(Stream* stream, int32& w, int32& h); // decodes TIM to RGBA, doesn't touch the GPU
     void init(uint8* data32, int32 w, int32 h);
     void free();
     void bind() const;
@@ -43,7 +44,7 @@ struct Animation
         uint16 start;
     };
 
-    uint32 framesInfo[MAX_ANIMATION_FRAMES];
+    uint32* framesInfo; // totalFrames
     Clip clips[MAX_ANIMATION_CLIPS];
     uint32 clipsCount;
     uint32 totalFrames;
@@ -81,10 +82,13 @@ struct Skeleton
     Offset offsets[MAX_RANGES];
     Link links[MAX_RANGES];
     uint32 count;
-    Frame frames[MAX_ANIMATION_FRAMES];
+    Frame* frames; // dataFramesCount
     int32 dataFramesCount;
+    int16* angles; // unpacked angles of the frames, x[anglesCount], y[anglesCount], z[anglesCount] per frame
+    int32 anglesCount;
 
     void load(Stream* stream, const Animation* anim);
+    void unpack(); // trades the memory for the bits unpacking of every joint per frame
     void free();
     void getAngles(int32 frameIndex, int32 jointIndex, int32& x, int32& y, int32& z) const;
 };
@@ -99,6 +103,28 @@ struct ClipInfo
 
 #define MAX_MODEL_ANIMS 3
 
+// entity state of a simulation tick, the renderer interpolates the last two ticks
+struct RenderState
+{
+    vec3i pos;
+    int32 angle;
+    int32 frameIndex;
+    const Skeleton* animSkeleton;
+};
+
+// CPU side of the model, uploaded to the GPU by Model::upload
+struct ModelData
+{
+    void* indices;
+    void* vertices;
+    int32 iCount;
+    int32 vCount;
+    uint8* texture32;
+    int32 textureWidth;
+    int32 textureHeight;
+    MmapStream* cooked; // the arrays above point into the mapped cooked blob if set
+};
+
 struct Model
 {
     Animation animation[MAX_MODEL_ANIMS];
@@ -111,13 +137,21 @@ struct Model
     uint32 rangesCount;
     MeshRange ranges[MAX_RANGES];
 
+    ModelData* data;
+
     void load(Stream* stream);
+    void loadData(Stream* stream);          // parses the model without touching the GPU
+    void loadTextureData(Stream* stream);   // same for an external TIM texture
+    bool loadCooked(MmapStream* stream, int32 offset);
+    uint8* cook(int32 offset, int32& size); // serializes the loaded data, the first offset bytes are reserved
+    void upload();
+    void freeData();
     void free();
     void updateInfo();
+    void unpackAngles();
     ClipInfo getClipInfo(int32 clipIndex);
 
-    void render(const vec3i& pos, int32 angle, uint16 frameIndex, const Texture* texture, const Skeleton* skeleton, const Skeleton* animSkeleton);
-    void renderMesh(uint32 meshIndex, uint32 frameIndex, const Skeleton* skeleton, const Skeleton* animSkeleton);
+    void render(const RenderState& prev, const RenderState& cur, int32 factor, const Texture* texture, const Skeleton* skeleton);
 };
 
 void renderInit();
@@ -129,6 +163,8 @@ void renderSetCamera(const vec3i& pos, const vec3i& target, int32 persp);
 void renderSetAmbient(uint8 r, uint8 g, uint8 b);
 void renderSetLight(int32 index, const vec3s& pos, uint8 r, uint8 g, uint8 b, uint16 intensity);
 void renderBackground(const Texture* texture, const Texture* masks, const MaskChunk* chunks, uint32 chunksCount);
+void renderModels(); // draws the models queued by Model::render
+void renderOverlay(const char* text); // multiline text in the top left corner
 
 #ifdef _DEBUG
 void renderDebugBegin(bool planar);
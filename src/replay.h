@@ -0,0 +1,190 @@
+#ifndef H_REPLAY
+#define H_REPLAY
+
+#include "common.h"
+
+// input log of the game ticks for the reproducible runs
+// the replay feeds the recorded pad state to the same ticks independent of the real time
+
+#define REPLAY_MAGIC        0x594C5052 // "RPLY"
+#define REPLAY_VERSION      1
+#define REPLAY_CAPACITY     4096 // ticks, grows twice on overflow
+
+extern int32 gPadStickY;
+
+struct ReplayHeader
+{
+    uint32 magic;
+    uint32 version;
+    int32 stageIndex;
+    int32 roomIndex;
+    int32 cameraIndex;
+    vec3i playerPos;
+    int32 playerAngle;
+    int32 ticksCount;
+};
+
+struct ReplayTick
+{
+    uint32 pad;
+    int16 stickX;
+    int16 stickY;
+};
+
+struct Replay
+{
+    enum Mode
+    {
+        MODE_NONE,
+        MODE_RECORD,
+        MODE_PLAY
+    };
+
+    Mode mode;
+    ReplayHeader header;
+    ReplayTick* ticks;
+    int32 capacity;
+    int32 tickIndex;
+    MmapStream* stream;
+    char path[256];
+
+    void init()
+    {
+        mode = MODE_NONE;
+        ticks = NULL;
+        capacity = 0;
+        tickIndex = 0;
+        stream = NULL;
+    }
+
+    // the start state is set by the caller
+    bool record(const char* fileName)
+    {
+        ASSERT(mode == MODE_NONE);
+
+        if (strlen(fileName) >= sizeof(path))
+        {
+            LOG("replay path is too long %s\n", fileName);
+            return false;
+        }
+
+        strcpy(path, fileName);
+
+        header.magic = REPLAY_MAGIC;
+        header.version = REPLAY_VERSION;
+        header.ticksCount = 0;
+
+        capacity = REPLAY_CAPACITY;
+        ticks = new ReplayTick[capacity];
+        tickIndex = 0;
+
+        mode = MODE_RECORD;
+
+        return true;
+    }
+
+    bool play(const char* fileName)
+    {
+        ASSERT(mode == MODE_NONE);
+
+        stream = new MmapStream(fileName);
+
+        if (stream->getSize() >= sizeof(header))
+        {
+            memcpy(&header, stream->span(0, sizeof(header)), sizeof(header));
+
+            // the count is checked against the file size before the multiplication, it may be corrupted
+            size_t maxTicks = (stream->getSize() - sizeof(header)) / sizeof(ReplayTick);
+
+            if (header.magic == REPLAY_MAGIC && header.version == REPLAY_VERSION && header.ticksCount >= 0 && size_t(header.ticksCount) <= maxTicks)
+            {
+                ticks = (ReplayTick*)stream->span(sizeof(header), header.ticksCount * int32(sizeof(ReplayTick)));
+                tickIndex = 0;
+                mode = MODE_PLAY;
+                return true;
+            }
+        }
+
+        LOG("invalid replay %s\n", fileName);
+
+        delete stream;
+        stream = NULL;
+
+        return false;
+    }
+
+    // called before the tick, overrides the pad state by the recorded one
+    void tick()
+    {
+        if (mode == MODE_RECORD)
+        {
+            if (tickIndex == capacity)
+            {
+                ReplayTick* data = new ReplayTick[capacity * 2];
+                memcpy(data, ticks, capacity * sizeof(ReplayTick));
+                delete[] ticks;
+                ticks = data;
+                capacity *= 2;
+            }
+
+            ReplayTick& t = ticks[tickIndex++];
+            t.pad = gPad;
+            t.stickX = gPadStickX;
+            t.stickY = gPadStickY;
+        }
+        else if (mode == MODE_PLAY)
+        {
+            if (tickIndex < header.ticksCount)
+            {
+                const ReplayTick& t = ticks[tickIndex++];
+                gPad = t.pad;
+                gPadStickX = t.stickX;
+                gPadStickY = t.stickY;
+            }
+            else
+            {
+                gPad = 0;
+            }
+        }
+    }
+
+    bool isFinished() const
+    {
+        return mode == MODE_PLAY && tickIndex >= header.ticksCount;
+    }
+
+    void free()
+    {
+        if (mode == MODE_RECORD)
+        {
+            header.ticksCount = tickIndex;
+
+            int32 size = sizeof(header) + tickIndex * sizeof(ReplayTick);
+            uint8* data = new uint8[size];
+            memcpy(data, &header, sizeof(header));
+            memcpy(data + sizeof(header), ticks, tickIndex * sizeof(ReplayTick));
+
+            if (osSaveFile(path, data, size))
+            {
+                LOG("replay saved %s ticks: %d\n", path, tickIndex);
+            }
+            else
+            {
+                LOG("can't save replay %s\n", path);
+            }
+
+            delete[] data;
+            delete[] ticks;
+        }
+        else if (mode == MODE_PLAY)
+        {
+            delete stream;
+        }
+
+        init();
+    }
+};
+
+Replay replay;
+
+#endif
@@ -2,14 +2,7 @@
 #define H_ROOM
 
 #include "common.h"
-
-#ifdef USE_ADT
-#include "lzss.h"
-#endif
-
-#ifdef USE_BSS
-#include "mdec.h"
-#endif
+#include "background.h"
 
 #define MAX_SAMPLES             48
 #define MAX_COLLISIONS          64
@@ -23,6 +16,7 @@
 #define MAX_MASKS               16
 
 #define DOOR_RADIUS             600
+#define DOOR_PRELOAD_RADIUS     3000
 
 void scriptRun(Stream* stream);
 
@@ -75,6 +69,39 @@ struct CameraSwitch
 
         return true;
     }
+
+    // distance from the point to the quad edges, 0 if the point is inside
+    int32 distance(int32 x, int32 y) const
+    {
+        if (intersect(x, y))
+            return 0;
+
+        float dist = edgeDist2(x, y, a, b);
+        dist = x_min(dist, edgeDist2(x, y, b, c));
+        dist = x_min(dist, edgeDist2(x, y, c, d));
+        dist = x_min(dist, edgeDist2(x, y, d, a));
+
+        return int32(sqrtf(dist));
+    }
+
+    static float edgeDist2(int32 x, int32 y, const vec2s& p, const vec2s& q)
+    {
+        float ex = float(q.x - p.x);
+        float ey = float(q.y - p.y);
+        float px = float(x - p.x);
+        float py = float(y - p.y);
+
+        float len2 = ex * ex + ey * ey;
+        float t = (len2 > 0.0f) ? (px * ex + py * ey) / len2 : 0.0f;
+
+        if (t < 0.0f) t = 0.0f;
+        if (t > 1.0f) t = 1.0f;
+
+        px -= ex * t;
+        py -= ey * t;
+
+        return px * px + py * py;
+    }
 };
 
 struct LightColor
@@ -160,8 +187,8 @@ struct Room
     Animation extraAnimation;
     Skeleton extraSkeleton;
 
-    Texture background;
-    Texture masks;
+    const Texture* background; // owned by bgCache
+    const Texture* masks;
 
     int32 stageIndex;
     int32 roomIndex;
@@ -201,13 +228,28 @@ struct Room
 
     void load(int32 stageIdx, int32 roomIdx, int32 cameraIdx)
     {
+        uint32 startTime = osGetSystemTimeMS();
+
+        bool preloaded = roomLoader.finish(stageIdx, roomIdx, playerIndex);
+
+        for (int32 i = 0; i < MAX_ENEMIES; i++)
+        {
+            if (enemies[i].active)
+            {
+                enemies[i].free();
+            }
+        }
+
         memset(doors, 0, sizeof(doors));
         memset(enemies, 0, sizeof(enemies));
 
         stageIndex = stageIdx;
         roomIndex = roomIdx;
+        roomLoader.uploadBackgrounds();
         loadInfo();
         setCameraIndex(cameraIdx);
+        roomLoader.endSwap();
+        modelCache.purge(); // models of the previous room
 
         player.collision = collisions + collisionsCount;
         for (int32 i = 0; i < MAX_ENEMIES; i++)
@@ -223,83 +265,38 @@ struct Room
             collision->shape.sx =
             collision->shape.sz = 0;
         }
+
+        roomLoader.swapTime = osGetSystemTimeMS() - startTime;
+
+        gCounters.add(preloaded ? CNT_ROOM_PRELOADED : CNT_ROOM_SYNC);
+        gCounters.add(CNT_ROOM_SWAP_TIME, roomLoader.swapTime);
+        gCounters.add(CNT_ROOM_WAIT_TIME, roomLoader.waitTime);
+
+        LOG("room [%d %d] %s swap: %d ms wait: %d ms\n", stageIndex, roomIndex,
+            preloaded ? "preloaded" : "sync", roomLoader.swapTime, roomLoader.waitTime);
     }
 
     void loadInfo()
     {
-        char path[64];
-        strcpy(path, "PL0/RDT/ROOM____.RDT");
-        path[12] = '0' + stageIndex;
-        addSuffix(path + 13, roomIndex);
-        path[15] = '0' + playerIndex;
+        MmapStream* stream = roomLoader.takeRDT();
 
-        LOG("load [%d %d %d] %s\n", stageIndex, roomIndex, playerIndex, path);
-
-        if (loadRDT(path))
-            return;
+        if (!stream)
+        {
+            stream = openRDT(stageIndex, roomIndex, playerIndex);
+        }
 
-        path[6] = 'U';
+        ASSERT(stream && "RDT not found");
 
-        if (loadRDT(path))
-            return;
+        loadRDT(stream);
 
-        ASSERT(0 && "RDT not found");
+        delete stream;
     }
 
-    bool loadRDT(const char* path)
+    void loadRDT(Stream* stream)
     {
-        FileStream stream(path);
-        if (!stream.isValid())
-            return false;
-
-        struct Header
-        {
-            uint8 sprites;
-            uint8 cameras;
-            uint8 models;
-            uint8 items;
-            uint8 doors;
-            uint8 unknown5;
-            uint8 reverb;
-            uint8 unknown7;
-        } header;
-
-        struct Offsets
-        {
-            uint32 samplesInfo;
-            uint32 samplesVH;
-            uint32 samplesVB;
-            uint32 unused0;
-            uint32 unused1;
-            uint32 objEnd;
-            uint32 collision;
-            uint32 cameras;
-            uint32 cameraSwitches;
-            uint32 cameraLights;
-            uint32 modelsInfo;
-            uint32 floors;
-            uint32 blocks;
-            uint32 text1;
-            uint32 text2;
-            uint32 unknown1;
-            uint32 scriptInit;
-            uint32 scriptMain;
-            uint32 spriteAnims;
-            uint32 spriteAnimsEnd;
-            uint32 spriteTex;
-            uint32 spriteTexEnd;
-            uint32 roomObj;
-        } offset;
-
-        for (int32 i = 0; i < sizeof(header); i++)
-        {
-            ((uint8*)&header)[i] = stream.u8();
-        }
-
-        for (int32 i = 0; i < sizeof(offset) >> 2; i++)
-        {
-            ((uint32*)&offset)[i] = stream.u32();
-        }
+        RDTHeader header;
+        RDTOffsets offset;
+        readRDTHeader(stream, header, offset);
 
         ASSERT(header.cameras <= MAX_CAMERAS);
         ASSERT(offset.samplesVH > offset.samplesInfo);
@@ -307,40 +304,40 @@ struct Room
         ASSERT(offset.unused1 == 0);
 
         { // samples info
-            stream.setPos(offset.samplesInfo);
+            stream->setPos(offset.samplesInfo);
             ASSERT((offset.samplesVH - offset.samplesInfo) / sizeof(SampleInfo) == MAX_SAMPLES);
 
             for (int32 i = 0; i < MAX_SAMPLES; i++)
             {
                 SampleInfo* info = samplesInfo + i;
-                info->id = stream.u8();
-                info->pan = stream.u8();
-                info->tone = stream.u8();
-                info->solo = stream.u8();
+                info->id = stream->u8();
+                info->pan = stream->u8();
+                info->tone = stream->u8();
+                info->solo = stream->u8();
             }
         }
 
         { // collisions
-            stream.setPos(offset.collision);
-            stream.skip(4);
-            //int16 cx = stream.s16(); // TODO ceiling
-            //int16 cz = stream.s16();
-            collisionsCount = stream.u32() - 1;
+            stream->setPos(offset.collision);
+            stream->skip(4);
+            //int16 cx = stream->s16(); // TODO ceiling
+            //int16 cz = stream->s16();
+            collisionsCount = stream->u32() - 1;
             ASSERT(collisionsCount <= MAX_COLLISIONS);
-            stream.skip(4);
-            // int32 ceiling = stream.s32(); // TODO ceiling
-            stream.skip(4);
+            stream->skip(4);
+            // int32 ceiling = stream->s32(); // TODO ceiling
+            stream->skip(4);
 
             for (int32 i = 0; i < collisionsCount; i++)
             {
                 Collision* collision = collisions + i;
-                collision->shape.x = stream.s16();
-                collision->shape.z = stream.s16();
-                collision->shape.sx = stream.u16();
-                collision->shape.sz = stream.u16();
-                collision->flags = stream.u16();
-                collision->type = stream.u16();
-                collision->floor = stream.u32();
+                collision->shape.x = stream->s16();
+                collision->shape.z = stream->s16();
+                collision->shape.sx = stream->u16();
+                collision->shape.sz = stream->u16();
+                collision->flags = stream->u16();
+                collision->type = stream->u16();
+                collision->floor = stream->u32();
             }
         }
 
@@ -355,19 +352,19 @@ struct Room
 
             MaskInfo maskInfo[MAX_MASKS];
 
-            stream.setPos(offset.cameras);
+            stream->setPos(offset.cameras);
             for (int32 i = 0; i < header.cameras; i++)
             {
                 Camera* camera = cameras + i;
-                camera->flags = stream.u16();
-                camera->persp = stream.u16() >> 7;
-                camera->pos.x = stream.s32();
-                camera->pos.y = stream.s32();
-                camera->pos.z = stream.s32();
-                camera->target.x = stream.s32();
-                camera->target.y = stream.s32();
-                camera->target.z = stream.s32();
-                maskOffsets[i] = stream.s32();
+                camera->flags = stream->u16();
+                camera->persp = stream->u16() >> 7;
+                camera->pos.x = stream->s32();
+                camera->pos.y = stream->s32();
+                camera->pos.z = stream->s32();
+                camera->target.x = stream->s32();
+                camera->target.y = stream->s32();
+                camera->target.z = stream->s32();
+                maskOffsets[i] = stream->s32();
             }
 
             // masks
@@ -384,9 +381,9 @@ struct Room
                     continue;
                 }
 
-                stream.setPos(maskOffsets[i]);
-                uint16 masksCount = stream.u16();
-                uint16 chunksCount = stream.u16();
+                stream->setPos(maskOffsets[i]);
+                uint16 masksCount = stream->u16();
+                uint16 chunksCount = stream->u16();
 
                 if (masksCount == 0xFFFF)
                     continue;
@@ -395,10 +392,10 @@ struct Room
 
                 for (uint32 j = 0; j < masksCount; j++)
                 {
-                    maskInfo[j].count = stream.u16();
-                    stream.skip(2); // unknown
-                    maskInfo[j].pos.x = stream.u16();
-                    maskInfo[j].pos.y = stream.u16();
+                    maskInfo[j].count = stream->u16();
+                    stream->skip(2); // unknown
+                    maskInfo[j].pos.x = stream->u16();
+                    maskInfo[j].pos.y = stream->u16();
                 }
 
                 camera->maskChunks = chunk;
@@ -410,20 +407,20 @@ struct Room
                     {
                         ASSERT(chunk - maskChunks < MAX_MASK_CHUNKS);
 
-                        chunk->src.x = stream.u8();
-                        chunk->src.y = stream.u8();
-                        chunk->dst.x = stream.u8() + maskInfo[j].pos.x;
-                        chunk->dst.y = stream.u8() + maskInfo[j].pos.y;
-                        chunk->depth = stream.u16();
-                        uint16 size = stream.u16();
+                        chunk->src.x = stream->u8();
+                        chunk->src.y = stream->u8();
+                        chunk->dst.x = stream->u8() + maskInfo[j].pos.x;
+                        chunk->dst.y = stream->u8() + maskInfo[j].pos.y;
+                        chunk->depth = stream->u16();
+                        uint16 size = stream->u16();
                         if (size)
                         {
                             chunk->size.x = chunk->size.y = size;
                         }
                         else
                         {
-                            chunk->size.x = stream.u16();
-                            chunk->size.y = stream.u16();
+                            chunk->size.x = stream->u16();
+                            chunk->size.y = stream->u16();
                         }
                     }
                 }
@@ -432,17 +429,17 @@ struct Room
         }
 
         { // camera switches
-            stream.setPos(offset.cameraSwitches);
+            stream->setPos(offset.cameraSwitches);
             int32 cameraSwitchesCount = 0;
             while (1)
             {
                 ASSERT(cameraSwitchesCount < MAX_CAMERA_SWITCHES);
                 CameraSwitch* cameraSwitch = cameraSwitches + cameraSwitchesCount++;
 
-                uint8 b0 = stream.u8();
-                uint8 b1 = stream.u8();
-                uint8 b2 = stream.u8();
-                uint8 b3 = stream.u8();
+                uint8 b0 = stream->u8();
+                uint8 b1 = stream->u8();
+                uint8 b2 = stream->u8();
+                uint8 b3 = stream->u8();
 
                 cameraSwitch->flags = b0;
                 cameraSwitch->floor = b1;
@@ -452,324 +449,100 @@ struct Room
                 if ((b0 & b1 & b2 & b3) == 0xFF)
                     break;
 
-                cameraSwitch->a.x = stream.s16();
-                cameraSwitch->a.y = stream.s16();
-                cameraSwitch->b.x = stream.s16();
-                cameraSwitch->b.y = stream.s16();
-                cameraSwitch->c.x = stream.s16();
-                cameraSwitch->c.y = stream.s16();
-                cameraSwitch->d.x = stream.s16();
-                cameraSwitch->d.y = stream.s16();
+                cameraSwitch->a.x = stream->s16();
+                cameraSwitch->a.y = stream->s16();
+                cameraSwitch->b.x = stream->s16();
+                cameraSwitch->b.y = stream->s16();
+                cameraSwitch->c.x = stream->s16();
+                cameraSwitch->c.y = stream->s16();
+                cameraSwitch->d.x = stream->s16();
+                cameraSwitch->d.y = stream->s16();
             }
         }
 
         { // camera lights
-            stream.setPos(offset.cameraLights);
+            stream->setPos(offset.cameraLights);
             for (int32 i = 0; i < header.cameras; i++)
             {
                 CameraLights* lights = cameraLights + i;
-                lights->unknown0 = stream.u8();
+                lights->unknown0 = stream->u8();
                 for (int32 j = 0; j < MAX_LIGHTS; j++)
                 {
-                    lights->types[j] = stream.u8();
+                    lights->types[j] = stream->u8();
                 }
                 for (int32 j = 0; j < MAX_LIGHTS; j++)
                 {
-                    lights->colors[j].r = stream.u8();
-                    lights->colors[j].g = stream.u8();
-                    lights->colors[j].b = stream.u8();
+                    lights->colors[j].r = stream->u8();
+                    lights->colors[j].g = stream->u8();
+                    lights->colors[j].b = stream->u8();
                 }
-                lights->ambient.r = stream.u8();
-                lights->ambient.g = stream.u8();
-                lights->ambient.b = stream.u8();
+                lights->ambient.r = stream->u8();
+                lights->ambient.g = stream->u8();
+                lights->ambient.b = stream->u8();
                 for (int32 j = 0; j < MAX_LIGHTS; j++)
                 {
-                    lights->pos[j].x = stream.s16();
-                    lights->pos[j].y = stream.s16();
-                    lights->pos[j].z = stream.s16();
+                    lights->pos[j].x = stream->s16();
+                    lights->pos[j].y = stream->s16();
+                    lights->pos[j].z = stream->s16();
                 }
                 for (int32 j = 0; j < MAX_LIGHTS; j++)
                 {
-                    lights->intensity[j] = stream.u16();
+                    lights->intensity[j] = stream->u16();
                 }
             }
         }
 
         { // floors
-            stream.setPos(offset.floors);
-            floorsCount = stream.u16();
+            stream->setPos(offset.floors);
+            floorsCount = stream->u16();
             ASSERT(floorsCount <= MAX_FLOORS);
             for (int32 i = 0; i < floorsCount; i++)
             {
                 Floor* floor = floors + i;
-                floor->shape.x = stream.s16();
-                floor->shape.z = stream.s16();
-                floor->shape.sx = stream.u16();
-                floor->shape.sz = stream.u16();
-                floor->soundIdx = stream.u16();
-                floor->y = stream.u16();
+                floor->shape.x = stream->s16();
+                floor->shape.z = stream->s16();
+                floor->shape.sx = stream->u16();
+                floor->shape.sz = stream->u16();
+                floor->soundIdx = stream->u16();
+                floor->y = stream->u16();
             }
         }
 
         { // blocks
-            stream.setPos(offset.blocks);
-            blocksCount = stream.u32();
+            stream->setPos(offset.blocks);
+            blocksCount = stream->u32();
             ASSERT(blocksCount <= MAX_BLOCKS);
             for (int32 i = 1; i < blocksCount; i++)
             {
                 Block* block = blocks + i;
-                block->minX = stream.s16();
-                block->minZ = stream.s16();
-                block->maxX = stream.s16();
-                block->maxZ = stream.s16();
-                block->unknown0 = stream.u16();
-                block->unknown1 = stream.u16();
+                block->minX = stream->s16();
+                block->minZ = stream->s16();
+                block->maxX = stream->s16();
+                block->maxZ = stream->s16();
+                block->unknown0 = stream->u16();
+                block->unknown1 = stream->u16();
                 ASSERT(block->minX < block->maxX);
                 ASSERT(block->minZ < block->maxZ);
             }
         }
 
         { // init script
-            stream.setPos(offset.scriptInit);
+            stream->setPos(offset.scriptInit);
             ASSERT(offset.scriptInit != 0xFFFFFFFF);
-            scriptRun(&stream);
+            scriptRun(stream);
         }
-
-        return true;
     }
 
     void loadBG()
     {
-    #ifdef USE_ADT
-        if (loadADT())
-            return;
-    #endif
-
-    #ifdef USE_BSS
-        if (loadBSS())
-            return;
-    #endif
-
-        ASSERT(0);
-    }
-
-#ifdef USE_ADT
-    #define MAX_BG_BUFFER_SIZE ((320 * 256 * 2) * 2)
-
-    bool loadADT()
-    {
-        FileStream stream("COMMON/BIN/ROOMCUT.BIN");
-        if (!stream.isValid())
-            return false;
-
-        int32 index = (stageIndex - 1) * 512 + roomIndex * 16 + cameraIndex;
-
-        int32 off = stream.u32();
-        int32 count = off / 4;
-        ASSERT(index < count);
-        
-        stream.setPos(index * 4);
-        int32 offset = stream.s32();
-        int32 size;
-        if (index == count - 1)
-        {
-            size = stream.getSize() - offset;
-        }
-        else
-        {
-            size = stream.s32() - offset;
-        }
-        ASSERT(size > 0);
-        stream.setPos(offset);
-
-        uint8 tmpData[128 << 10];
-        ASSERT(size < sizeof(tmpData));
-        
-        stream.read(tmpData, size);
-
-        uint8* buffer = new uint8[MAX_BG_BUFFER_SIZE];
-        buffer[320 * 256 * 2] = 0xFF; // special mark to override by masks data
-
-        unpackImage(tmpData + 4, size - 4, buffer); // skip magic
-
-        uint8* data32 = new uint8[320 * 240 * 4];
-        uint16* src = (uint16*)buffer;
-        uint8* dst = data32;
-
-        for (int32 y = 0; y < 240; y++)
-        {
-            for (int32 x = 0; x < 256; x++)
-            {
-                uint16 value = *src++;
-
-                *dst++ = (value & 31) << 3;
-                *dst++ = ((value >> 5) & 31) << 3;
-                *dst++ = ((value >> 10) & 31) << 3;
-                *dst++ = 255;
-            }
+        PROFILE("Room::loadBG");
 
-            uint16* part = (uint16*)buffer + 256 * 256 + y * 128;
+        const BackgroundCache::Entry* entry = bgCache.get(stageIndex, roomIndex, cameraIndex);
+        ASSERT(entry);
 
-            if (y >= 128)
-            {
-                part -= 128 * 128 - 64;
-            }
-
-            for (int32 x = 0; x < 64; x++)
-            {
-                uint16 value = *part++;
-
-                *dst++ = (value & 31) << 3;
-                *dst++ = ((value >> 5) & 31) << 3;
-                *dst++ = ((value >> 10) & 31) << 3;
-                *dst++ = 255;
-            }
-        }
-
-        background.x = 0;
-        background.y = 0;
-        background.count = 1;
-        background.init(data32, 320, 240);
-
-        if (buffer[320 * 256 * 2] != 0xFF) // has masks
-        {
-            MemoryStream masksStream(buffer, MAX_BG_BUFFER_SIZE);
-            masksStream.setPos(320 * 256 * 2);
-            masks.load(&masksStream);
-        }
-
-    #if 0
-    #ifdef _DEBUG
-        dumpBitmap("rooms.bmp", 320, 240, data32);
-    #endif
-    #endif
-
-        delete[] data32;
-        delete[] buffer;
-
-        return true;
+        background = &entry->background;
+        masks = &entry->masks;
     }
-#endif
-
-#ifdef USE_BSS
-    // based on Patrice Mandin code https://github.com/pmandin/reevengi-tools/wiki/.BSS
-    uint8* bss_tim_re2(uint8* src, int32& size)
-    {
-        if (*(uint16*)(src + 4) != 0xFFFF)
-        {
-            size = 0;
-            return NULL;
-        }
-        size = (*((uint32*)src)); // TODO BE support
-        src += 6;
-
-        uint8* dst = new uint8[size];
-        uint8* ret = src;
-
-        int count;
-        while (1)
-        {
-            while (!(*src & 0x10))
-            {
-                int32 prev = *src & 0x0F;
-                int32 offset = ((*src++ & 0xE0) - 256) << 3;
-                offset |= *src++;
-
-                if (prev == 0x0F)
-                {
-                    prev += *src++;
-                }
-                prev += 3;
-
-                while (prev--)
-                {
-                    dst[0] = dst[offset];
-                    dst++;
-                }
-            }
-
-            if (*src == 0xff)
-                break;
-
-            int32 next = ((*src++ | 0xFFE0) ^ 0xFFFF) + 1;
-            if (next == 0x10)
-            {
-                next += *src++;
-            }
-
-            memcpy(dst, src, next);
-            dst += next;
-            src += next;
-        }
-
-        return dst - size;
-    }
-
-    bool loadBSS()
-    {
-        char path[32];
-        strcpy(path, "COMMON/BSS/ROOM");
-        path[15] = '0' + stageIndex;
-        addSuffix(path + 16, roomIndex);
-        strcat(path, ".BSS");
-
-        FileStream stream(path);
-        if (!stream.isValid())
-            return false;
-
-        int32 sectionSize = 64 << 10; // TODO: 32 for RE1
-        stream.skip(cameraIndex * sectionSize);
-
-        int32 length = stream.u16();
-        int32 id = stream.u16();
-        ASSERT(id == 0x3800);
-        int32 qscale = stream.u16();
-        int32 version = stream.u16();
-
-        int32 bufSize = stream.getSize() - stream.getPos();
-        if (bufSize > sectionSize)
-            bufSize = sectionSize;
-
-        uint8* buffer = new uint8[bufSize];
-        stream.read(buffer, bufSize);
-
-        uint8* data32 = new uint8[320 * 240 * 4];
-        
-        int32 maskOffset = mdec_decode(buffer, version, 320, 240, qscale, data32);
-
-        // TODO proper calc of maskOffset
-        maskOffset += 3;
-        while (1)
-        {
-            uint32 mask = buffer[maskOffset + 1] | (buffer[maskOffset + 2] << 8);
-            if ((buffer[maskOffset] == 0) && (mask == 0xFFFF || mask == 0x0000))
-            {
-                maskOffset -= 3;
-                break;
-            }
-            maskOffset++;
-        }
-
-        background.x = 0;
-        background.y = 0;
-        background.count = 1;
-        background.init(data32, 320, 240);
-
-        int32 timSize;
-        uint8* timData = bss_tim_re2(buffer + maskOffset, timSize);
-        if (timData)
-        {
-            MemoryStream masksStream(timData, timSize);
-            masks.load(&masksStream);
-            delete[] timData;
-        }
-
-        delete[] data32;
-        delete[] buffer;
-
-        return true;
-    }
-#endif
 
     void setEnemy(int32 id, int32 model, int32 x, int32 y, int32 z, int32 angle)
     {
@@ -787,6 +560,7 @@ struct Room
         enemy->pos.z = z;
         enemy->angle = angle << 4; // 4096 -> 65536
         enemy->active = true;
+        enemy->prevState = enemy->getState();
     }
 
     void setDoor(int32 id, const Door* door)
@@ -836,6 +610,8 @@ struct Room
 
     void checkCameraSwitch()
     {
+        PROFILE("Room::checkCameraSwitch");
+
         const CameraSwitch* cameraSwitch = cameraSwitchStart;
 
         while (1)
@@ -848,6 +624,8 @@ struct Room
             if (cameraSwitch->floor != player.floor && cameraSwitch->floor != 0xFF)
                 continue;
 
+            gCounters.add(CNT_CAMERA_SWITCHES);
+
             if (cameraSwitch->intersect(player.pos.x, player.pos.z))
             {
                 setCameraIndex(cameraSwitch->to);
@@ -856,6 +634,80 @@ struct Room
         }
     }
 
+    // decode backgrounds of the cameras reachable from the current one in advance
+    void prefetchCameras()
+    {
+        int32 keys[MAX_BG_PREFETCH];
+        int32 priorities[MAX_BG_PREFETCH];
+        int32 count = 0;
+
+        const CameraSwitch* cameraSwitch = cameraSwitchStart;
+
+        while (1)
+        {
+            cameraSwitch++;
+
+            if (cameraSwitch->from != cameraIndex)
+                break;
+
+            // same filter as checkCameraSwitch, the switches of the other floors are unreachable
+            if (cameraSwitch->floor != player.floor && cameraSwitch->floor != 0xFF)
+                continue;
+
+            int32 key = BackgroundCache::getKey(stageIndex, roomIndex, cameraSwitch->to);
+            int32 dist = cameraSwitch->distance(player.pos.x, player.pos.z);
+
+            int32 index = 0;
+            while (index < count && keys[index] != key)
+                index++;
+
+            if (index == count)
+            {
+                if (count == MAX_BG_PREFETCH)
+                    continue;
+                keys[count] = key;
+                priorities[count] = dist;
+                count++;
+            }
+            else
+            {
+                priorities[index] = x_min(priorities[index], dist);
+            }
+        }
+
+        bgCache.prefetch(keys, priorities, count);
+        bgCache.update();
+    }
+
+    // start loading the room behind the closest door in advance
+    void preloadDoors()
+    {
+        const Door* target = NULL;
+        int32 targetDist = DOOR_PRELOAD_RADIUS;
+
+        const Door* door = doors;
+        for (int32 i = 0; i < MAX_DOORS; i++, door++)
+        {
+            if (!door->shape.sx && !door->shape.sz)
+                continue;
+
+            int32 dx = x_max(door->shape.x - player.pos.x, player.pos.x - (door->shape.x + door->shape.sx));
+            int32 dz = x_max(door->shape.z - player.pos.z, player.pos.z - (door->shape.z + door->shape.sz));
+            int32 dist = x_max(x_max(dx, dz), 0);
+
+            if (dist < targetDist)
+            {
+                target = door;
+                targetDist = dist;
+            }
+        }
+
+        if (target)
+        {
+            roomLoader.request(target->stageIdx + 1, target->roomIdx, target->cameraIdx, playerIndex);
+        }
+    }
+
     bool isVisible(int32 x, int32 z, int32 floor)
     {
         // TODO check floor
@@ -864,6 +716,10 @@ struct Room
 
     void collide(int32 r, vec3i& pos, uint32 floorMask, uint32 flagsMask)
     {
+        PROFILE("Room::collide");
+
+        gCounters.add(CNT_COLLISIONS, collisionsCount + 1 + MAX_ENEMIES);
+
         for (int32 i = 0; i < collisionsCount + 1 + MAX_ENEMIES; i++)
         {
             const Collision* collision = collisions + i;
@@ -886,6 +742,8 @@ struct Room
 
     void update()
     {
+        PROFILE("Room::update");
+
         player.stairs = NULL;
         player.update();
 
@@ -907,6 +765,8 @@ struct Room
         player.updateStairs();
 
         checkCameraSwitch();
+        prefetchCameras();
+        preloadDoors();
 
         if (gPad & IN_A)
         {
@@ -934,7 +794,7 @@ struct Room
     {
         const Camera* camera = cameras + cameraIndex;
         
-        renderBackground(&background, &masks, camera->maskChunks, camera->maskChunksCount);
+        renderBackground(background, masks, camera->maskChunks, camera->maskChunksCount);
 
         renderSetCamera(camera->pos, camera->target, camera->persp);
 
@@ -952,6 +812,8 @@ struct Room
 
         player.render();
 
+        renderModels();
+
     #ifdef _DEBUG
         renderDebugBegin(false);
 
@@ -132,13 +132,23 @@ enum CompareFunc
 
 #define MAX_SCRIPT_SUBS 16
 
-uint16 gScriptSubs[MAX_SCRIPT_SUBS];
+struct ScriptContext
+{
+    uint16 subs[MAX_SCRIPT_SUBS];
+    ScriptResources* resources; // if set, only collects the resources and doesn't touch the room
+};
 
-int32 scriptProcess(Stream* stream)
+int32 scriptProcess(Stream* stream, ScriptContext* ctx)
 {
     while (1)
     {
         ScriptCmd cmd = (ScriptCmd)stream->u8();
+
+        if (!ctx->resources) // the scan runs on the loader thread
+        {
+            gCounters.add(CNT_SCRIPT_OPS);
+        }
+
         switch (cmd)
         {
             case CMD_NOP:
@@ -160,7 +170,7 @@ int32 scriptProcess(Stream* stream)
             {
                 stream->skip(2); // TODO
                 uint8 sub = stream->u8();
-                stream->setPos(gScriptSubs[sub]);
+                stream->setPos(ctx->subs[sub]);
                 break;
             }
 
@@ -261,7 +271,13 @@ int32 scriptProcess(Stream* stream)
 
             case CMD_CAM_SET:
             {
-                room.setCameraIndex(stream->u8());
+                uint8 cameraIndex = stream->u8();
+                if (ctx->resources)
+                {
+                    ctx->resources->cameraIndex = cameraIndex;
+                    break;
+                }
+                room.setCameraIndex(cameraIndex);
                 break;
             }
 
@@ -300,6 +316,8 @@ int32 scriptProcess(Stream* stream)
                 pos.x = stream->s16();
                 pos.y = stream->s16();
                 pos.z = stream->s16();
+                if (ctx->resources)
+                    break;
                 room.player.pos = pos;
                 break;
             }
@@ -359,6 +377,8 @@ int32 scriptProcess(Stream* stream)
                 door.keyId = stream->u8();
                 door.keyType = stream->u8();
                 door.unlocked = stream->u8();
+                if (ctx->resources)
+                    break;
                 room.setDoor(id, &door);
                 break;
             }
@@ -401,6 +421,11 @@ int32 scriptProcess(Stream* stream)
                 int16 z = stream->s16();
                 int16 angle = stream->s16();
                 stream->skip(4); // TODO
+                if (ctx->resources)
+                {
+                    ctx->resources->addModel(model);
+                    break;
+                }
                 room.setEnemy(id, model, x, y, z, angle);
                 break;
             }
@@ -425,6 +450,8 @@ int32 scriptProcess(Stream* stream)
             {
                 uint8 from = stream->u8();
                 uint8 to = stream->u8();
+                if (ctx->resources)
+                    break;
                 room.swapCameraSwitch(from, to);
                 break;
             }
@@ -514,23 +541,38 @@ int32 scriptProcess(Stream* stream)
     }
 }
 
-void scriptRun(Stream* stream)
+void scriptStart(Stream* stream, ScriptContext* ctx)
 {
     int32 basePos = stream->getPos();
 
     int32 count = stream->u16();
-    gScriptSubs[0] = count + basePos;
+    ctx->subs[0] = count + basePos;
 
     count >>= 1;
     ASSERT(count <= MAX_SCRIPT_SUBS);
 
     for (int32 i = 1; i < count; i++)
     {
-        gScriptSubs[i] = stream->u16() + basePos;
+        ctx->subs[i] = stream->u16() + basePos;
     }
 
-    stream->setPos(gScriptSubs[0]);
-    scriptProcess(stream);
+    stream->setPos(ctx->subs[0]);
+    scriptProcess(stream, ctx);
+}
+
+void scriptRun(Stream* stream)
+{
+    ScriptContext ctx;
+    ctx.resources = NULL;
+    scriptStart(stream, &ctx);
+}
+
+// runs the script without side effects, safe to call from any thread
+void scriptScan(Stream* stream, ScriptResources* resources)
+{
+    ScriptContext ctx;
+    ctx.resources = resources;
+    scriptStart(stream, &ctx);
 }
 
 #endif
@@ -0,0 +1,294 @@
+#ifndef H_SIMD
+#define H_SIMD
+
+#include "types.h"
+
+// 8 x int32 vector for the fixed point kernels
+// AVX2 / SSE2 / NEON backends, plain struct otherwise
+
+#if defined(__AVX2__)
+    #define SIMD_AVX2
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SIMD_SSE2
+    #include <emmintrin.h>
+    #ifdef __SSE4_1__
+        #include <smmintrin.h>
+    #endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define SIMD_NEON
+    #include <arm_neon.h>
+#else
+    #define SIMD_SCALAR
+#endif
+
+#if defined(SIMD_SSE2) || defined(SIMD_AVX2)
+// RGBA pixels from 8 + 8 int16 channel values, saturated to [-128, 127] and biased by 128
+static inline void simd_storeRGBA(uint8* dst, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i bias = _mm_set1_epi8(-128);
+
+    __m128i rb = _mm_xor_si128(_mm_packs_epi16(r, b), bias);
+    __m128i ga = _mm_xor_si128(_mm_packs_epi16(g, _mm_set1_epi16(127)), bias);
+
+    __m128i rg = _mm_unpacklo_epi8(rb, ga);
+    __m128i ba = _mm_unpackhi_epi8(rb, ga);
+
+    _mm_storeu_si128((__m128i*)dst + 0, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i*)dst + 1, _mm_unpackhi_epi16(rg, ba));
+}
+#endif
+
+#if defined(SIMD_AVX2)
+
+struct v8i
+{
+    __m256i v;
+};
+
+static inline v8i v8i_make(__m256i v) { v8i r; r.v = v; return r; }
+
+static inline v8i v8i_load(const int32* ptr) { return v8i_make(_mm256_loadu_si256((const __m256i*)ptr)); }
+static inline void v8i_store(int32* ptr, v8i a) { _mm256_storeu_si256((__m256i*)ptr, a.v); }
+static inline v8i v8i_set1(int32 x) { return v8i_make(_mm256_set1_epi32(x)); }
+static inline v8i operator + (v8i a, v8i b) { return v8i_make(_mm256_add_epi32(a.v, b.v)); }
+static inline v8i operator - (v8i a, v8i b) { return v8i_make(_mm256_sub_epi32(a.v, b.v)); }
+static inline v8i operator * (v8i a, int32 x) { return v8i_make(_mm256_mullo_epi32(a.v, _mm256_set1_epi32(x))); }
+template <int N> static inline v8i v8i_sra(v8i a) { return v8i_make(_mm256_srai_epi32(a.v, N)); }
+template <int N> static inline v8i v8i_sll(v8i a) { return v8i_make(_mm256_slli_epi32(a.v, N)); }
+
+// a0 a0 a1 a1 a2 a2 a3 a3
+static inline v8i v8i_dupLo(const int32* ptr)
+{
+    __m256i a = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)ptr));
+    return v8i_make(_mm256_permutevar8x32_epi32(a, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3)));
+}
+
+static inline void v8i_transpose(v8i* m)
+{
+    __m256i t0 = _mm256_unpacklo_epi32(m[0].v, m[1].v);
+    __m256i t1 = _mm256_unpackhi_epi32(m[0].v, m[1].v);
+    __m256i t2 = _mm256_unpacklo_epi32(m[2].v, m[3].v);
+    __m256i t3 = _mm256_unpackhi_epi32(m[2].v, m[3].v);
+    __m256i t4 = _mm256_unpacklo_epi32(m[4].v, m[5].v);
+    __m256i t5 = _mm256_unpackhi_epi32(m[4].v, m[5].v);
+    __m256i t6 = _mm256_unpacklo_epi32(m[6].v, m[7].v);
+    __m256i t7 = _mm256_unpackhi_epi32(m[6].v, m[7].v);
+
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    m[0].v = _mm256_permute2x128_si256(u0, u4, 0x20);
+    m[1].v = _mm256_permute2x128_si256(u1, u5, 0x20);
+    m[2].v = _mm256_permute2x128_si256(u2, u6, 0x20);
+    m[3].v = _mm256_permute2x128_si256(u3, u7, 0x20);
+    m[4].v = _mm256_permute2x128_si256(u0, u4, 0x31);
+    m[5].v = _mm256_permute2x128_si256(u1, u5, 0x31);
+    m[6].v = _mm256_permute2x128_si256(u2, u6, 0x31);
+    m[7].v = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+static inline void v8i_storeRGBA(uint8* dst, v8i r, v8i g, v8i b)
+{
+    simd_storeRGBA(dst,
+        _mm_packs_epi32(_mm256_castsi256_si128(r.v), _mm256_extracti128_si256(r.v, 1)),
+        _mm_packs_epi32(_mm256_castsi256_si128(g.v), _mm256_extracti128_si256(g.v, 1)),
+        _mm_packs_epi32(_mm256_castsi256_si128(b.v), _mm256_extracti128_si256(b.v, 1)));
+}
+
+#elif defined(SIMD_SSE2)
+
+struct v8i
+{
+    __m128i lo, hi;
+};
+
+static inline v8i v8i_make(__m128i lo, __m128i hi) { v8i r; r.lo = lo; r.hi = hi; return r; }
+
+static inline __m128i simd_mullo(__m128i a, __m128i b)
+{
+#ifdef __SSE4_1__
+    return _mm_mullo_epi32(a, b);
+#else
+    // low 32 bits of the product are the same for signed and unsigned
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+
+static inline v8i v8i_load(const int32* ptr) { return v8i_make(_mm_loadu_si128((const __m128i*)ptr), _mm_loadu_si128((const __m128i*)ptr + 1)); }
+static inline void v8i_store(int32* ptr, v8i a) { _mm_storeu_si128((__m128i*)ptr, a.lo); _mm_storeu_si128((__m128i*)ptr + 1, a.hi); }
+static inline v8i v8i_set1(int32 x) { __m128i v = _mm_set1_epi32(x); return v8i_make(v, v); }
+static inline v8i operator + (v8i a, v8i b) { return v8i_make(_mm_add_epi32(a.lo, b.lo), _mm_add_epi32(a.hi, b.hi)); }
+static inline v8i operator - (v8i a, v8i b) { return v8i_make(_mm_sub_epi32(a.lo, b.lo), _mm_sub_epi32(a.hi, b.hi)); }
+static inline v8i operator * (v8i a, int32 x) { __m128i v = _mm_set1_epi32(x); return v8i_make(simd_mullo(a.lo, v), simd_mullo(a.hi, v)); }
+template <int N> static inline v8i v8i_sra(v8i a) { return v8i_make(_mm_srai_epi32(a.lo, N), _mm_srai_epi32(a.hi, N)); }
+template <int N> static inline v8i v8i_sll(v8i a) { return v8i_make(_mm_slli_epi32(a.lo, N), _mm_slli_epi32(a.hi, N)); }
+
+static inline v8i v8i_dupLo(const int32* ptr)
+{
+    __m128i a = _mm_loadu_si128((const __m128i*)ptr);
+    return v8i_make(_mm_unpacklo_epi32(a, a), _mm_unpackhi_epi32(a, a));
+}
+
+static inline void simd_transpose4(__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+{
+    __m128i t0 = _mm_unpacklo_epi32(a, b);
+    __m128i t1 = _mm_unpackhi_epi32(a, b);
+    __m128i t2 = _mm_unpacklo_epi32(c, d);
+    __m128i t3 = _mm_unpackhi_epi32(c, d);
+    a = _mm_unpacklo_epi64(t0, t2);
+    b = _mm_unpackhi_epi64(t0, t2);
+    c = _mm_unpacklo_epi64(t1, t3);
+    d = _mm_unpackhi_epi64(t1, t3);
+}
+
+static inline void v8i_transpose(v8i* m)
+{
+    simd_transpose4(m[0].lo, m[1].lo, m[2].lo, m[3].lo);
+    simd_transpose4(m[4].hi, m[5].hi, m[6].hi, m[7].hi);
+    simd_transpose4(m[0].hi, m[1].hi, m[2].hi, m[3].hi);
+    simd_transpose4(m[4].lo, m[5].lo, m[6].lo, m[7].lo);
+    // swap the off-diagonal 4x4 blocks
+    for (int32 i = 0; i < 4; i++)
+    {
+        __m128i t = m[i].hi;
+        m[i].hi = m[i + 4].lo;
+        m[i + 4].lo = t;
+    }
+}
+
+static inline void v8i_storeRGBA(uint8* dst, v8i r, v8i g, v8i b)
+{
+    simd_storeRGBA(dst, _mm_packs_epi32(r.lo, r.hi), _mm_packs_epi32(g.lo, g.hi), _mm_packs_epi32(b.lo, b.hi));
+}
+
+#elif defined(SIMD_NEON)
+
+struct v8i
+{
+    int32x4_t lo, hi;
+};
+
+static inline v8i v8i_make(int32x4_t lo, int32x4_t hi) { v8i r; r.lo = lo; r.hi = hi; return r; }
+
+static inline v8i v8i_load(const int32* ptr) { return v8i_make(vld1q_s32(ptr), vld1q_s32(ptr + 4)); }
+static inline void v8i_store(int32* ptr, v8i a) { vst1q_s32(ptr, a.lo); vst1q_s32(ptr + 4, a.hi); }
+static inline v8i v8i_set1(int32 x) { int32x4_t v = vdupq_n_s32(x); return v8i_make(v, v); }
+static inline v8i operator + (v8i a, v8i b) { return v8i_make(vaddq_s32(a.lo, b.lo), vaddq_s32(a.hi, b.hi)); }
+static inline v8i operator - (v8i a, v8i b) { return v8i_make(vsubq_s32(a.lo, b.lo), vsubq_s32(a.hi, b.hi)); }
+static inline v8i operator * (v8i a, int32 x) { return v8i_make(vmulq_n_s32(a.lo, x), vmulq_n_s32(a.hi, x)); }
+template <int N> static inline v8i v8i_sra(v8i a) { return v8i_make(vshrq_n_s32(a.lo, N), vshrq_n_s32(a.hi, N)); }
+template <int N> static inline v8i v8i_sll(v8i a) { return v8i_make(vshlq_n_s32(a.lo, N), vshlq_n_s32(a.hi, N)); }
+
+static inline v8i v8i_dupLo(const int32* ptr)
+{
+    int32x4x2_t z = vzipq_s32(vld1q_s32(ptr), vld1q_s32(ptr));
+    return v8i_make(z.val[0], z.val[1]);
+}
+
+static inline void simd_transpose4(int32x4_t& a, int32x4_t& b, int32x4_t& c, int32x4_t& d)
+{
+    int32x4x2_t ab = vtrnq_s32(a, b);
+    int32x4x2_t cd = vtrnq_s32(c, d);
+    a = vcombine_s32(vget_low_s32(ab.val[0]), vget_low_s32(cd.val[0]));
+    b = vcombine_s32(vget_low_s32(ab.val[1]), vget_low_s32(cd.val[1]));
+    c = vcombine_s32(vget_high_s32(ab.val[0]), vget_high_s32(cd.val[0]));
+    d = vcombine_s32(vget_high_s32(ab.val[1]), vget_high_s32(cd.val[1]));
+}
+
+static inline void v8i_transpose(v8i* m)
+{
+    simd_transpose4(m[0].lo, m[1].lo, m[2].lo, m[3].lo);
+    simd_transpose4(m[4].hi, m[5].hi, m[6].hi, m[7].hi);
+    simd_transpose4(m[0].hi, m[1].hi, m[2].hi, m[3].hi);
+    simd_transpose4(m[4].lo, m[5].lo, m[6].lo, m[7].lo);
+    for (int32 i = 0; i < 4; i++)
+    {
+        int32x4_t t = m[i].hi;
+        m[i].hi = m[i + 4].lo;
+        m[i + 4].lo = t;
+    }
+}
+
+static inline uint8x8_t simd_packU8(v8i a)
+{
+    int8x8_t s = vqmovn_s16(vcombine_s16(vqmovn_s32(a.lo), vqmovn_s32(a.hi)));
+    return veor_u8(vreinterpret_u8_s8(s), vdup_n_u8(0x80));
+}
+
+static inline void v8i_storeRGBA(uint8* dst, v8i r, v8i g, v8i b)
+{
+    uint8x8x4_t p;
+    p.val[0] = simd_packU8(r);
+    p.val[1] = simd_packU8(g);
+    p.val[2] = simd_packU8(b);
+    p.val[3] = vdup_n_u8(255);
+    vst4_u8(dst, p);
+}
+
+#else
+
+struct v8i
+{
+    int32 v[8];
+};
+
+static inline v8i v8i_load(const int32* ptr) { v8i r; memcpy(r.v, ptr, sizeof(r.v)); return r; }
+static inline void v8i_store(int32* ptr, v8i a) { memcpy(ptr, a.v, sizeof(a.v)); }
+static inline v8i v8i_set1(int32 x) { v8i r; for (int32 i = 0; i < 8; i++) r.v[i] = x; return r; }
+static inline v8i operator + (v8i a, v8i b) { for (int32 i = 0; i < 8; i++) a.v[i] += b.v[i]; return a; }
+static inline v8i operator - (v8i a, v8i b) { for (int32 i = 0; i < 8; i++) a.v[i] -= b.v[i]; return a; }
+static inline v8i operator * (v8i a, int32 x) { for (int32 i = 0; i < 8; i++) a.v[i] = int32(uint32(a.v[i]) * uint32(x)); return a; }
+template <int N> static inline v8i v8i_sra(v8i a) { for (int32 i = 0; i < 8; i++) a.v[i] >>= N; return a; }
+template <int N> static inline v8i v8i_sll(v8i a) { for (int32 i = 0; i < 8; i++) a.v[i] = int32(uint32(a.v[i]) << N); return a; }
+
+static inline v8i v8i_dupLo(const int32* ptr)
+{
+    v8i r;
+    for (int32 i = 0; i < 8; i++)
+    {
+        r.v[i] = ptr[i >> 1];
+    }
+    return r;
+}
+
+static inline void v8i_transpose(v8i* m)
+{
+    for (int32 i = 0; i < 8; i++)
+    {
+        for (int32 j = i + 1; j < 8; j++)
+        {
+            int32 t = m[i].v[j];
+            m[i].v[j] = m[j].v[i];
+            m[j].v[i] = t;
+        }
+    }
+}
+
+static inline uint8 simd_clampU8(int32 x)
+{
+    return (x < -128) ? 0 : ((x > 127) ? 255 : (x + 128));
+}
+
+static inline void v8i_storeRGBA(uint8* dst, v8i r, v8i g, v8i b)
+{
+    for (int32 i = 0; i < 8; i++, dst += 4)
+    {
+        dst[0] = simd_clampU8(r.v[i]);
+        dst[1] = simd_clampU8(g.v[i]);
+        dst[2] = simd_clampU8(b.v[i]);
+        dst[3] = 255;
+    }
+}
+
+#endif
+
+#endif
@@ -4,8 +4,17 @@
 #include <stdio.h>
 #include "types.h"
 
+#define FILE_STREAM_BUFFER_SIZE (4 << 10)
+
 struct Stream
 {
+    // window of the data available for the inlined reads, maintained by the implementation
+    const uint8* bufPtr;
+    const uint8* bufEnd;
+
+    Stream() : bufPtr(NULL), bufEnd(NULL) {}
+    virtual ~Stream() {}
+
     virtual bool isValid() = 0;
     virtual int32 getPos() = 0;
     virtual void setPos(int32 pos) = 0;
@@ -13,8 +22,21 @@ struct Stream
     virtual void skip(int32 bytes) = 0;
     virtual int32 read(void* dst, int32 size) = 0;
 
+    template <typename T>
+    void readArray(T* dst, int32 count)
+    {
+        read(dst, count * sizeof(T));
+    }
+
     inline int32 s32()
     {
+        if (bufPtr + 4 <= bufEnd)
+        {
+            int32 value = int32(bufPtr[0] | (bufPtr[1] << 8) | (bufPtr[2] << 16) | (uint32(bufPtr[3]) << 24));
+            bufPtr += 4;
+            return value;
+        }
+
         int32 value;
         read(&value, sizeof(value));
         return value;
@@ -27,6 +49,13 @@ struct Stream
 
     inline int16 s16()
     {
+        if (bufPtr + 2 <= bufEnd)
+        {
+            int16 value = int16(bufPtr[0] | (bufPtr[1] << 8));
+            bufPtr += 2;
+            return value;
+        }
+
         int16 value;
         read(&value, sizeof(value));
         return value;
@@ -39,6 +68,11 @@ struct Stream
 
     inline int8 s8()
     {
+        if (bufPtr < bufEnd)
+        {
+            return (int8)*bufPtr++;
+        }
+
         int8 value;
         read(&value, sizeof(value));
         return value;
@@ -54,6 +88,8 @@ struct Stream
 struct FileStream : Stream
 {
     FILE* f;
+    int32 bufPos; // file position of the buffer start
+    uint8 buffer[FILE_STREAM_BUFFER_SIZE];
 
     FileStream(const char* fileName);
 
@@ -72,17 +108,28 @@ struct FileStream : Stream
 
     virtual int32 getPos()
     {
+        if (bufEnd)
+        {
+            return bufPos + int32(bufPtr - buffer);
+        }
         return ftell(f);
     }
 
     virtual void setPos(int32 pos)
     {
+        if (bufEnd && pos >= bufPos && pos <= bufPos + int32(bufEnd - buffer))
+        {
+            bufPtr = buffer + (pos - bufPos);
+            return;
+        }
+
         fseek(f, pos, SEEK_SET);
+        bufPtr = bufEnd = NULL;
     }
 
     virtual int32 getSize()
     {
-        int32 pos = getPos();
+        int32 pos = ftell(f);
         fseek(f, 0, SEEK_END);
         int32 size = ftell(f);
         fseek(f, pos, SEEK_SET);
@@ -91,15 +138,62 @@ struct FileStream : Stream
 
     virtual void skip(int32 bytes)
     {
-        fseek(f, bytes, SEEK_CUR);
+        setPos(getPos() + bytes);
     }
 
     virtual int32 read(void* dst, int32 bytes)
     {
-        int32 res = (int32)fread(dst, 1, bytes, f);
-        ASSERT(bytes == res);
+        uint8* ptr = (uint8*)dst;
+        int32 count = bytes;
+
+        while (count > 0)
+        {
+            int32 avail = int32(bufEnd - bufPtr);
+
+            if (avail <= 0)
+            {
+                // the file position matches the stream position when the buffer is empty
+                if (count >= FILE_STREAM_BUFFER_SIZE) // large reads go directly to the destination
+                {
+                    bufPtr = bufEnd = NULL;
+
+                    int32 res = (int32)fread(ptr, 1, count, f);
+                    ASSERT(count == res);
+                    (void)res;
+                    return bytes;
+                }
+
+                if (!fill())
+                {
+                    ASSERT(false);
+                    return bytes;
+                }
+                continue;
+            }
+
+            if (avail > count)
+            {
+                avail = count;
+            }
+
+            memcpy(ptr, bufPtr, avail);
+            bufPtr += avail;
+            ptr += avail;
+            count -= avail;
+        }
+
         return bytes;
     }
+
+    bool fill()
+    {
+        bufPos = getPos();
+        int32 res = (int32)fread(buffer, 1, FILE_STREAM_BUFFER_SIZE, f);
+        bufPtr = buffer;
+        bufEnd = buffer + res;
+
+        return res > 0;
+    }
 };
 
 
@@ -107,10 +201,20 @@ struct MemoryStream : Stream
 {
     uint8* data;
     int32 size;
-    int32 pos;
 
-    MemoryStream(uint8* data, int32 size) : data(data), size(size), pos(0) {}
-    
+    MemoryStream(uint8* data, int32 size)
+    {
+        setData(data, size);
+    }
+
+    void setData(uint8* data, int32 size)
+    {
+        this->data = data;
+        this->size = size;
+        bufPtr = data;
+        bufEnd = data + size;
+    }
+
     virtual bool isValid()
     {
         return data != NULL;
@@ -118,12 +222,12 @@ struct MemoryStream : Stream
 
     virtual int32 getPos()
     {
-        return pos;
+        return int32(bufPtr - data);
     }
 
     virtual void setPos(int32 pos)
     {
-        this->pos = pos;
+        bufPtr = data + pos;
     }
 
     virtual int32 getSize()
@@ -133,15 +237,50 @@ struct MemoryStream : Stream
 
     virtual void skip(int32 bytes)
     {
-        pos += bytes;
+        bufPtr += bytes;
     }
 
     virtual int32 read(void* dst, int32 bytes)
     {
-        memcpy(dst, data + pos, bytes);
-        pos += bytes;
+        ASSERT(bufPtr + bytes <= bufEnd);
+        memcpy(dst, bufPtr, bytes);
+        bufPtr += bytes;
         return bytes;
     }
+
+    // direct access to the data without copying
+    const uint8* span(int32 pos, int32 bytes)
+    {
+        ASSERT(pos >= 0 && pos + bytes <= size);
+        return data + pos;
+    }
+};
+
+
+// read-only view of the whole file, mapped to memory by the platform or loaded to the heap as a fallback
+struct MmapStream : MemoryStream
+{
+    void* handle; // platform mapping handle
+    bool mapped;
+
+    MmapStream(const char* fileName);
+    ~MmapStream();
+
+    void loadHeap(const char* fileName)
+    {
+        FILE* f = fopen(fileName, "rb");
+        if (!f)
+            return;
+
+        fseek(f, 0, SEEK_END);
+        int32 size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+
+        uint8* ptr = new uint8[size];
+        setData(ptr, (int32)fread(ptr, 1, size, f));
+
+        fclose(f);
+    }
 };
 
 #endif
@@ -0,0 +1,215 @@
+#ifndef H_THREAD
+#define H_THREAD
+
+#include "types.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+#define MAX_WORKERS     8
+#define MAX_JOBS        64
+
+typedef void (*JobProc)(void* param);
+
+struct Mutex
+{
+#ifdef _WIN32
+    CRITICAL_SECTION cs;
+
+    Mutex()         { InitializeCriticalSection(&cs); }
+    ~Mutex()        { DeleteCriticalSection(&cs); }
+    void lock()     { EnterCriticalSection(&cs); }
+    void unlock()   { LeaveCriticalSection(&cs); }
+#else
+    pthread_mutex_t mutex;
+
+    Mutex()         { pthread_mutex_init(&mutex, NULL); }
+    ~Mutex()        { pthread_mutex_destroy(&mutex); }
+    void lock()     { pthread_mutex_lock(&mutex); }
+    void unlock()   { pthread_mutex_unlock(&mutex); }
+#endif
+};
+
+struct Condition
+{
+#ifdef _WIN32
+    CONDITION_VARIABLE cv;
+
+    Condition()             { InitializeConditionVariable(&cv); }
+    void wait(Mutex& m)     { SleepConditionVariableCS(&cv, &m.cs, INFINITE); }
+    void signal()           { WakeConditionVariable(&cv); }
+    void broadcast()        { WakeAllConditionVariable(&cv); }
+#else
+    pthread_cond_t cv;
+
+    Condition()             { pthread_cond_init(&cv, NULL); }
+    ~Condition()            { pthread_cond_destroy(&cv); }
+    void wait(Mutex& m)     { pthread_cond_wait(&cv, &m.mutex); }
+    void signal()           { pthread_cond_signal(&cv); }
+    void broadcast()        { pthread_cond_broadcast(&cv); }
+#endif
+};
+
+struct Thread
+{
+    JobProc proc;
+    void* param;
+
+#ifdef _WIN32
+    HANDLE handle;
+
+    static DWORD WINAPI entry(LPVOID ptr)
+    {
+        Thread* t = (Thread*)ptr;
+        t->proc(t->param);
+        return 0;
+    }
+
+    void start(JobProc proc, void* param)
+    {
+        this->proc = proc;
+        this->param = param;
+        handle = CreateThread(NULL, 0, entry, this, 0, NULL);
+    }
+
+    void join()
+    {
+        WaitForSingleObject(handle, INFINITE);
+        CloseHandle(handle);
+    }
+#else
+    pthread_t handle;
+
+    static void* entry(void* ptr)
+    {
+        Thread* t = (Thread*)ptr;
+        t->proc(t->param);
+        return NULL;
+    }
+
+    void start(JobProc proc, void* param)
+    {
+        this->proc = proc;
+        this->param = param;
+        pthread_create(&handle, NULL, entry, this);
+    }
+
+    void join()
+    {
+        pthread_join(handle, NULL);
+    }
+#endif
+};
+
+int32 getCPUCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    return sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+struct WorkerPool
+{
+    struct Job
+    {
+        JobProc proc;
+        void* param;
+    };
+
+    Mutex mutex;
+    Condition jobReady;
+    Thread threads[MAX_WORKERS];
+    Job jobs[MAX_JOBS];
+    int32 count;
+    int32 first;
+    int32 jobsCount;
+    bool quit;
+
+    void init(int32 threadsCount)
+    {
+        count = threadsCount;
+        if (count < 0) count = 0;
+        if (count > MAX_WORKERS) count = MAX_WORKERS;
+        first = 0;
+        jobsCount = 0;
+        quit = false;
+
+        for (int32 i = 0; i < count; i++)
+        {
+            threads[i].start(worker, this);
+        }
+    }
+
+    void free()
+    {
+        mutex.lock();
+        quit = true;
+        jobReady.broadcast();
+        mutex.unlock();
+
+        for (int32 i = 0; i < count; i++)
+        {
+            threads[i].join();
+        }
+        count = 0;
+    }
+
+    // runs the job on the caller thread if there are no workers or the queue is full
+    void push(JobProc proc, void* param)
+    {
+        mutex.lock();
+
+        if (!count || jobsCount == MAX_JOBS)
+        {
+            mutex.unlock();
+            proc(param);
+            return;
+        }
+
+        Job& job = jobs[(first + jobsCount) % MAX_JOBS];
+        job.proc = proc;
+        job.param = param;
+        jobsCount++;
+
+        jobReady.signal();
+        mutex.unlock();
+    }
+
+    static void worker(void* param)
+    {
+        WorkerPool* pool = (WorkerPool*)param;
+
+        pool->mutex.lock();
+        while (1)
+        {
+            while (!pool->jobsCount && !pool->quit)
+            {
+                pool->jobReady.wait(pool->mutex);
+            }
+
+            if (!pool->jobsCount) // quit
+                break;
+
+            Job job = pool->jobs[pool->first];
+            pool->first = (pool->first + 1) % MAX_JOBS;
+            pool->jobsCount--;
+
+            pool->mutex.unlock();
+            job.proc(job.param);
+            pool->mutex.lock();
+        }
+        pool->mutex.unlock();
+    }
+};
+
+WorkerPool workers;
+
+#endif
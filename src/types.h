@@ -12,6 +12,8 @@ typedef short int           int16;
 typedef unsigned short int  uint16;
 typedef int                 int32;
 typedef unsigned int        uint32;
+typedef long long           int64;
+typedef unsigned long long  uint64;
 
 typedef uint16 Index;
 